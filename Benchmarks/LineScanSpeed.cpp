@@ -0,0 +1,106 @@
+#include "ViFi/LineScanner.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace {
+// Result of scanning a text, compared across kernels.
+struct Result {
+  std::size_t lines;   // Number of lines.
+  std::size_t checked; // Sum of separator positions and valid ids.
+};
+
+// Build a text like WriteText::write() with given number of entry lines.
+std::string syntheticText(std::size_t lines) {
+  std::string text = "# ViFi@/base\n";
+  text.reserve(lines * 40);
+  char id[32];
+  for (std::size_t i = 1; i <= lines; ++i) {
+    auto end = std::to_chars(id, id + sizeof(id), i, 16).ptr;
+    text.append(16 - static_cast<std::size_t>(end - id), '0');
+    text.append(id, end);
+    text += "\tdir" + std::to_string(i / 10000) + "/sub" +
+            std::to_string(i / 100 % 100) + "/file" + std::to_string(i % 100) +
+            ".pdf\n";
+  }
+  return text;
+}
+
+// Scan lines by searching for each separator.
+Result scanFind(std::string_view text) {
+  Result result = {0, 0};
+  for (std::size_t begin = 0; begin < text.size();) {
+    std::size_t end = std::min(text.find('\n', begin), text.size());
+    std::string_view line = text.substr(begin, end - begin);
+    std::size_t separator = line.find('\t');
+    std::size_t id = 0;
+    if (separator != std::string_view::npos &&
+        std::from_chars(line.data(), line.data() + separator, id, 16).ptr ==
+            line.data() + separator) {
+      ++result.checked;
+    }
+    result.checked += separator;
+    ++result.lines;
+    begin = end + 1;
+  }
+  return result;
+}
+
+// Scan lines with a line scanner kernel.
+Result scanKernel(std::string_view text, LineScanner::Kernel kernel) {
+  Result result = {0, 0};
+  LineScanner scanner(text, kernel);
+  LineScanner::Line line = {};
+  while (scanner.next(line)) {
+    result.checked += line.separator + (line.hexId ? 1 : 0);
+    ++result.lines;
+  }
+  return result;
+}
+
+// Print the best throughput of some runs.
+template <typename Scan>
+void measure(const char *name, std::string_view text, Scan scan) {
+  double best = 0.0;
+  Result result = {0, 0};
+  for (int run = 0; run < 3; ++run) {
+    auto start = std::chrono::steady_clock::now();
+    result = scan(text);
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+    best = std::max(best, text.size() / duration.count() / 1e9);
+  }
+  std::printf("%-8s %6.2f GB/s  %zu lines  check %zu\n", name, best,
+              result.lines, result.checked);
+}
+} // namespace
+
+/*!
+ * \brief Measure the line scanning throughput of the text reader.
+ *
+ * Scans a synthetic text of 10M entry lines, or the number of lines given as
+ * argument, with each kernel the CPU supports and with plain searching.
+ */
+int main(int argc, char *argv[]) {
+  std::size_t lines = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+  std::string text = syntheticText(lines);
+  std::printf("%zu lines, %.2f GB\n", lines, text.size() / 1e9);
+  measure("find", text, scanFind);
+  const std::pair<const char *, LineScanner::Kernel> kernels[] = {
+      {"scalar", LineScanner::Kernel::Scalar},
+      {"sse2", LineScanner::Kernel::SSE2},
+      {"avx2", LineScanner::Kernel::AVX2}};
+  for (const auto &kernel : kernels) {
+    if (LineScanner::supported(kernel.second)) {
+      measure(kernel.first, text, [&](std::string_view scanned) {
+        return scanKernel(scanned, kernel.second);
+      });
+    }
+  }
+  return 0;
+}
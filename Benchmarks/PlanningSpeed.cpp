@@ -0,0 +1,64 @@
+#include "ViFi/FileTree.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+constexpr int DIRS = 100;  // Directories per year directory.
+constexpr int FILES = 99;  // Files per directory.
+
+// Load a tree of year directories with about 10k entries each, which is
+// moved into a new archive directory so that every entry changes its path.
+void loadTree(FileTree &tree, int years) {
+  for (int target = 0; target < 2; ++target) {
+    tree.setBasePath("/base");
+    const FileTree::Node *base = tree.baseNode();
+    if (target) {
+      base = tree.addEntry(base, "archive");
+    }
+    FileTree::Id id = 1;
+    for (int y = 0; y < years; ++y) {
+      const FileTree::Node *year =
+          tree.addEntry(base, id++, "year" + std::to_string(y));
+      for (int d = 0; d < DIRS; ++d) {
+        const FileTree::Node *dir =
+            tree.addEntry(year, id++, "dir" + std::to_string(d));
+        for (int f = 0; f < FILES; ++f) {
+          tree.addEntry(dir, id++, "file" + std::to_string(f) + ".pdf");
+        }
+      }
+    }
+    if (!target) {
+      tree.endOriginal();
+    }
+  }
+}
+} // namespace
+
+/*!
+ * \brief Measure the planning time of the move step for growing trees.
+ *
+ * Plans synthetic trees from 10k up to 10M entries, or up to the number of
+ * entries given as first argument, on the number of threads given as second
+ * argument. Linear planning keeps the time per entry about the same.
+ */
+int main(int argc, char *argv[]) {
+  std::size_t limit = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+  std::size_t threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+  std::printf("%10s %10s %10s %10s\n", "entries", "ms", "ns/entry",
+              "visits");
+  for (std::size_t years = 1; years * 10000 <= limit; years *= 10) {
+    FileTree tree;
+    loadTree(tree, static_cast<int>(years));
+    auto start = std::chrono::steady_clock::now();
+    tree.endTarget(threads);
+    std::chrono::duration<double, std::milli> duration =
+        std::chrono::steady_clock::now() - start;
+    double entries = static_cast<double>(tree.maxEntryId() + 1);
+    std::printf("%10.0f %10.1f %10.1f %10zu\n", entries, duration.count(),
+                duration.count() * 1e6 / entries, tree.planStats().visits);
+  }
+  return 0;
+}
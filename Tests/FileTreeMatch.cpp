@@ -31,14 +31,18 @@ protected:
    */
   void checkOperations(const std::string &current, const std::string &changed,
                        const FileOpSequence &order) {
-    FileTree tree;
-    std::istringstream inCurrent(current);
-    ReadText::read(inCurrent, tree);
-    tree.endOriginal();
-    std::istringstream inChanged(changed);
-    ReadText::read(inChanged, tree);
-    tree.endTarget();
-    checkOperations(tree, order);
+    // Planning on several threads must give the same result. Tasks of a
+    // single entry put even these small levels on the work pool.
+    for (std::size_t threads : {1, 4}) {
+      FileTree tree;
+      std::istringstream inCurrent(current);
+      ReadText::read(inCurrent, tree);
+      tree.endOriginal();
+      std::istringstream inChanged(changed);
+      ReadText::read(inChanged, tree);
+      tree.endTarget(threads, 1);
+      checkOperations(tree, order);
+    }
   }
 };
 
@@ -117,6 +121,29 @@ TEST_F(FileTreeMatch, DeleteDirectory) {
   checkOperations(current.str(), changed.str(), order);
 }
 
+TEST_F(FileTreeMatch, CopyUnchangedDirectory) {
+  std::ostringstream current;
+  current << "# ViFi@/base" << std::endl;
+  current << "01" << '\t' << "dirA" << std::endl;
+  current << "02" << '\t' << "dirA/file1.txt" << std::endl;
+  current << "03" << '\t' << "dirB" << std::endl;
+  current << "04" << '\t' << "dirB/file2.txt" << std::endl;
+  std::ostringstream changed;
+  changed << "# ViFi@/base" << std::endl;
+  changed << "01" << '\t' << "dirA" << std::endl;
+  changed << "02" << '\t' << "dirA/file1.txt" << std::endl;
+  changed << "01" << '\t' << "dirC" << std::endl;
+  changed << "02" << '\t' << "dirC/file1.txt" << std::endl;
+  changed << "03" << '\t' << "dirB" << std::endl;
+  changed << "04" << '\t' << "dirB/file3.txt" << std::endl;
+  FileOpSequence order;
+  order.addOutOp(4, "/base/dirB/file2.txt", false, 2, 2, 1);
+  order.addInOp(4, "/base/dirB/file3.txt", false, 2, 2);
+  order.addOutOp(1, "/base/dirA", true, 1, 1, 1);
+  order.addInOp(1, "/base/dirC", false, 1, 1);
+  checkOperations(current.str(), changed.str(), order);
+}
+
 TEST_F(FileTreeMatch, IntermediateDirectories) {
   std::ostringstream current;
   current << "# ViFi@/base" << std::endl;
@@ -0,0 +1,100 @@
+#include "ViFi/FileOpSequence.hpp"
+#include "ViFi/FileTree.hpp"
+#include "gtest/gtest.h"
+#include <array>
+#include <string>
+
+/*!
+ * \brief Test planning work and parallel planning of large file trees.
+ * \see FileTree
+ */
+class FileTreeScaling : public testing::Test {
+protected:
+  //! Number of directories per year directory.
+  static constexpr int DIRS = 100;
+  //! Number of files per directory.
+  static constexpr int FILES = 99;
+
+  /*!
+   * \brief Load a synthetic tree that is moved into a new subdirectory.
+   *
+   * The original tree has year directories with DIRS directories of FILES
+   * files each, about 10k entries per year. The target tree moves all of
+   * them into a new archive directory, so every entry changes its path and
+   * requests the new intermediate directory.
+   * \param tree File tree to load, must be empty.
+   * \param years Number of year directories.
+   */
+  void loadTree(FileTree &tree, int years) {
+    for (int target = 0; target < 2; ++target) {
+      tree.setBasePath("/base");
+      const FileTree::Node *base = tree.baseNode();
+      if (target) {
+        base = tree.addEntry(base, "archive");
+      }
+      FileTree::Id id = 1;
+      for (int y = 0; y < years; ++y) {
+        const FileTree::Node *year =
+            tree.addEntry(base, id++, "year" + std::to_string(2000 + y));
+        for (int d = 0; d < DIRS; ++d) {
+          const FileTree::Node *dir =
+              tree.addEntry(year, id++, "dir" + std::to_string(d));
+          for (int f = 0; f < FILES; ++f) {
+            tree.addEntry(dir, id++, "file" + std::to_string(f) + ".pdf");
+          }
+        }
+      }
+      if (!target) {
+        tree.endOriginal();
+      }
+    }
+  }
+
+  /*!
+   * \brief Plan a synthetic tree and get the work done per entry.
+   * \param years Number of year directories, about 10k entries each.
+   * \return Planning statistics divided by the number of entries.
+   */
+  std::array<double, 3> planningWork(int years) {
+    FileTree tree;
+    loadTree(tree, years);
+    tree.endTarget();
+    const FileTree::PlanStats &stats = tree.planStats();
+    double entries = static_cast<double>(tree.maxEntryId() + 1);
+    return {stats.requests / entries, stats.visits / entries,
+            stats.moves / entries};
+  }
+};
+
+TEST_F(FileTreeScaling, NearLinearPlanning) {
+  // Work per entry from 10k to 300k entries, quadratic planning would grow
+  // by a factor of 30. Every entry is four levels deep in the target.
+  std::array<double, 3> small = planningWork(1);
+  for (int years : {10, 30}) {
+    std::array<double, 3> large = planningWork(years);
+    for (std::size_t i = 0; i < small.size(); ++i) {
+      EXPECT_LE(large[i], small[i] * 1.01) << years << " years, stat " << i;
+      EXPECT_LE(large[i], 8.0) << years << " years, stat " << i;
+    }
+  }
+}
+
+TEST_F(FileTreeScaling, ParallelPlanning) {
+  // Levels of 10k entries are split across the threads.
+  FileTree serialTree;
+  loadTree(serialTree, 3);
+  serialTree.endTarget();
+  FileOpSequence serial;
+  serialTree.generate(serial);
+  FileTree parallelTree;
+  loadTree(parallelTree, 3);
+  parallelTree.endTarget(4);
+  FileOpSequence parallel;
+  parallelTree.generate(parallel);
+  EXPECT_FALSE(serial.empty());
+  EXPECT_TRUE(serial == parallel);
+  // The same work is done, only split across the threads.
+  EXPECT_EQ(serialTree.planStats().requests, parallelTree.planStats().requests);
+  EXPECT_EQ(serialTree.planStats().visits, parallelTree.planStats().visits);
+  EXPECT_EQ(serialTree.planStats().moves, parallelTree.planStats().moves);
+}
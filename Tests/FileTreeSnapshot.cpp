@@ -0,0 +1,157 @@
+#include "ViFi/FileOpSequence.hpp"
+#include "ViFi/FileTree.hpp"
+#include "ViFi/ReadText.hpp"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+/*!
+ * \brief Test binary snapshots of original file trees.
+ * \see FileTree
+ */
+class FileTreeSnapshot : public testing::Test {
+protected:
+  //! Original file tree in text format.
+  const std::string current = "# ViFi@/base\n"
+                              "01\tdirB\n"
+                              "02\tdirB/file.txt\n"
+                              "03\tdirA\n"
+                              "04\tdirA/file.txt\n"
+                              "05\tdirA/sub\n"
+                              "06\tdirA/sub/file.txt\n"
+                              "07\tfile.txt\n";
+
+  //! Changed file tree in text format.
+  const std::string changed = "# ViFi@/base\n"
+                              "01\tdirB\n"
+                              "04\tdirB/file.txt\n"
+                              "03\tdirA\n"
+                              "02\tdirA/file.txt\n"
+                              "05\tdirC/sub\n"
+                              "06\tdirC/sub/file.txt\n"
+                              "06\tfile.txt\n";
+
+  //! Location of the snapshot file.
+  fs::path file = fs::temp_directory_path() / "ViFiSnapshotTest";
+
+  //! Location of the text file the snapshot belongs to.
+  fs::path textFile = fs::temp_directory_path() / "ViFiSnapshotText";
+
+  void SetUp() override { std::ofstream(textFile.string()) << current; }
+
+  void TearDown() override {
+    fs::remove(file);
+    fs::remove(textFile);
+  }
+
+  /*!
+   * \brief Read a file tree from text.
+   * \param tree File tree to load.
+   * \param text File tree in text format, see ReadText::read().
+   */
+  void readText(FileTree &tree, const std::string &text) {
+    std::istringstream in(text);
+    ReadText::read(in, tree);
+  }
+};
+
+TEST_F(FileTreeSnapshot, SameTreeAndOperations) {
+  FileTree text;
+  readText(text, current);
+  text.endOriginal();
+  text.saveSnapshot(file, textFile);
+  FileTree snapshot;
+  ASSERT_TRUE(snapshot.loadSnapshot(file, textFile));
+  EXPECT_TRUE(snapshot == text);
+  EXPECT_EQ(text.maxEntryId(), snapshot.maxEntryId());
+  // Both trees must plan the same operations for the changed tree.
+  readText(text, changed);
+  text.endTarget();
+  FileOpSequence textOps;
+  text.generate(textOps);
+  textOps.prepare();
+  readText(snapshot, changed);
+  snapshot.endTarget();
+  FileOpSequence snapshotOps;
+  snapshot.generate(snapshotOps);
+  snapshotOps.prepare();
+  EXPECT_FALSE(textOps.empty());
+  EXPECT_TRUE(textOps == snapshotOps);
+}
+
+TEST_F(FileTreeSnapshot, UnfinishedTree) {
+  FileTree tree;
+  readText(tree, current);
+  EXPECT_THROW(tree.saveSnapshot(file, textFile), std::runtime_error);
+}
+
+TEST_F(FileTreeSnapshot, InvalidFile) {
+  FileTree tree;
+  EXPECT_FALSE(tree.loadSnapshot(file, textFile));
+  std::ofstream(file.string()) << current;
+  EXPECT_FALSE(tree.loadSnapshot(file, textFile));
+  // A truncated snapshot is rejected as well.
+  FileTree original;
+  readText(original, current);
+  original.endOriginal();
+  original.saveSnapshot(file, textFile);
+  fs::resize_file(file, fs::file_size(file) - 8);
+  EXPECT_FALSE(tree.loadSnapshot(file, textFile));
+}
+
+TEST_F(FileTreeSnapshot, DuplicateName) {
+  FileTree original;
+  readText(original, current);
+  original.endOriginal();
+  original.saveSnapshot(file, textFile);
+  // Rename dirB to dirA within the stored names.
+  std::string data;
+  {
+    std::ifstream in(file.string(), std::ios_base::binary);
+    data.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+  }
+  std::size_t name = data.find("dirB");
+  ASSERT_NE(std::string::npos, name);
+  data[name + 3] = 'A';
+  std::ofstream(file.string(), std::ios_base::binary) << data;
+  FileTree tree;
+  EXPECT_FALSE(tree.loadSnapshot(file, textFile));
+  EXPECT_EQ(0U, tree.maxEntryId());
+}
+
+TEST_F(FileTreeSnapshot, ChangedText) {
+  FileTree original;
+  readText(original, current);
+  original.endOriginal();
+  original.saveSnapshot(file, textFile);
+  FileTree tree;
+  ASSERT_TRUE(tree.loadSnapshot(file, textFile));
+  // The snapshot does not belong to another or an edited text file.
+  EXPECT_FALSE(tree.loadSnapshot(file, file));
+  std::ofstream(textFile.string()) << changed;
+  fs::last_write_time(textFile, fs::last_write_time(textFile) -
+                                    std::chrono::seconds(1));
+  EXPECT_FALSE(tree.loadSnapshot(file, textFile));
+  fs::remove(textFile);
+  EXPECT_FALSE(tree.loadSnapshot(file, textFile));
+}
+
+TEST_F(FileTreeSnapshot, DeepTree) {
+  // Close to the maximum depth, without running out of stack.
+  FileTree tree;
+  tree.setBasePath("/base");
+  const FileTree::Node *dir = tree.baseNode();
+  for (FileTree::Id id = 1; id <= 60000; ++id) {
+    dir = tree.addEntry(dir, id, "dir");
+  }
+  tree.endOriginal();
+  tree.saveSnapshot(file, textFile);
+  FileTree snapshot;
+  ASSERT_TRUE(snapshot.loadSnapshot(file, textFile));
+  EXPECT_TRUE(snapshot == tree);
+}
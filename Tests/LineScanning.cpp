@@ -0,0 +1,86 @@
+#include "ViFi/LineScanner.hpp"
+#include "gtest/gtest.h"
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*!
+ * \brief Test splitting texts into lines with all kernels.
+ * \see LineScanner
+ */
+class LineScanning : public testing::Test {
+protected:
+  //! All kernels, supported or not.
+  const std::vector<LineScanner::Kernel> kernels = {
+      LineScanner::Kernel::Scalar, LineScanner::Kernel::SSE2,
+      LineScanner::Kernel::AVX2};
+
+  /*!
+   * \brief Check the lines of a text against plain searching.
+   * \param text Text to split into lines.
+   */
+  void checkLines(std::string_view text) {
+    for (LineScanner::Kernel kernel : kernels) {
+      if (!LineScanner::supported(kernel)) {
+        continue;
+      }
+      LineScanner scanner(text, kernel);
+      LineScanner::Line line = {};
+      for (std::size_t begin = 0; begin < text.size();) {
+        std::size_t end = std::min(text.find('\n', begin), text.size());
+        std::string_view expected = text.substr(begin, end - begin);
+        std::size_t separator = expected.find('\t');
+        bool hexId = separator > 0 && separator <= 16 &&
+                     separator != std::string_view::npos &&
+                     expected.find_first_not_of("0123456789abcdefABCDEF") ==
+                         separator;
+        ASSERT_TRUE(scanner.next(line));
+        EXPECT_EQ(expected.data(), line.text.data());
+        EXPECT_EQ(expected.size(), line.text.size());
+        EXPECT_EQ(separator, line.separator);
+        EXPECT_EQ(hexId, line.hexId) << expected;
+        begin = end + 1;
+      }
+      EXPECT_FALSE(scanner.next(line));
+      EXPECT_EQ(text.size(), scanner.position());
+    }
+  }
+};
+
+TEST_F(LineScanning, SimpleLines) {
+  checkLines("");
+  checkLines("\n");
+  checkLines("\n\n");
+  checkLines("# ViFi@/base\n01\tfile\n");
+  checkLines("# ViFi@/base\n01\tfile");
+  checkLines("0A\tfile\nfF\tdir\tname\n\t\nxy\tfile\n0x1\tfile\n");
+  checkLines("00000000000000001\tfile\n0000000000000001\tfile\n");
+}
+
+TEST_F(LineScanning, LongLinesAndBlockBorders) {
+  // Lines from empty to longer than the classified window of 4096 bytes.
+  for (std::size_t size : {0, 1, 62, 63, 64, 65, 127, 128, 4095, 4096, 5000}) {
+    std::string text;
+    for (int i = 0; i < 3; ++i) {
+      text += "0a\t" + std::string(size, 'x') + '\n';
+      text += std::string(size, 'b') + "\tz\n";
+    }
+    checkLines(text);
+    checkLines(text.substr(0, text.size() - 1));
+  }
+}
+
+TEST_F(LineScanning, RandomText) {
+  std::mt19937 random(42);
+  const char chars[] = "\n\t0123456789abcdefABCDEFgxyz/ \xc3\xa4";
+  std::uniform_int_distribution<std::size_t> pick(0, sizeof(chars) - 2);
+  for (int run = 0; run < 20; ++run) {
+    std::string text(static_cast<std::size_t>(run) * 500, ' ');
+    for (char &c : text) {
+      c = chars[pick(random)];
+    }
+    checkLines(text);
+  }
+}
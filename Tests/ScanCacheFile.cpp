@@ -0,0 +1,87 @@
+#include "ViFi/ScanCache.hpp"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/*!
+ * \brief Test saving and loading scan cache files.
+ * \see ScanCache
+ */
+class ScanCacheFile : public testing::Test {
+protected:
+  //! Base directory of the cached listings.
+  const fs::path base = "/base";
+
+  //! Location of the cache file.
+  fs::path file = fs::temp_directory_path() / "ViFiScanCacheTest";
+
+  void TearDown() override { fs::remove(file); }
+
+  /*!
+   * \brief Save a cache with one listing of two entries.
+   */
+  void saveCache() {
+    ScanCache cache(base);
+    ScanCache::Directory directory;
+    directory.stamp.inode = 42;
+    directory.entries = {{"file.txt", false}, {"dir", true}};
+    cache.store("", directory);
+    cache.save(file);
+  }
+
+  /*!
+   * \brief Overwrite bytes of the cache file.
+   * \param offset Position of the first byte to overwrite.
+   * \param value Value to write in native byte order.
+   */
+  template <typename T> void patchCache(std::streamoff offset, T value) {
+    std::fstream io(file.string(), std::ios_base::in | std::ios_base::out |
+                                       std::ios_base::binary);
+    io.seekp(offset);
+    io.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  //! Offset of the entry count of the listing in the cache file.
+  std::streamoff entriesOffset() const {
+    // Magic, base, settings, scan time, listing count, key and stamp.
+    return 11 + (4 + base.string().size()) + 4 + 8 + 8 + 4 +
+           sizeof(ScanCache::Stamp);
+  }
+};
+
+TEST_F(ScanCacheFile, SaveAndLoad) {
+  saveCache();
+  ScanCache cache(base);
+  ASSERT_TRUE(cache.load(file));
+  ASSERT_EQ(1U, cache.size());
+  const ScanCache::Directory *directory = cache.get("");
+  ASSERT_NE(nullptr, directory);
+  EXPECT_EQ(42U, directory->stamp.inode);
+  ASSERT_EQ(2U, directory->entries.size());
+  EXPECT_EQ("dir", directory->entries[1].name);
+  EXPECT_TRUE(directory->entries[1].directory);
+  // Listings of another base directory are not used.
+  ScanCache other("/other");
+  EXPECT_FALSE(other.load(file));
+}
+
+TEST_F(ScanCacheFile, InvalidFile) {
+  ScanCache cache(base);
+  EXPECT_FALSE(cache.load(file));
+  std::ofstream(file.string()) << "# ViFi@/base\n";
+  EXPECT_FALSE(cache.load(file));
+  // A truncated cache is rejected.
+  saveCache();
+  fs::resize_file(file, fs::file_size(file) - 2);
+  EXPECT_FALSE(cache.load(file));
+  EXPECT_EQ(0U, cache.size());
+  // Sizes beyond the end of the file are rejected without allocating them.
+  saveCache();
+  patchCache(entriesOffset(), ~std::uint64_t(0));
+  EXPECT_FALSE(cache.load(file));
+  saveCache();
+  patchCache(entriesOffset() + 8 + sizeof(bool), ~std::uint32_t(0));
+  EXPECT_FALSE(cache.load(file));
+  EXPECT_EQ(0U, cache.size());
+}
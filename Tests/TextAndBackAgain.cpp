@@ -3,7 +3,12 @@
 #include "ViFi/WriteText.hpp"
 #include "gtest/gtest.h"
 #include <exception>
+#include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
 
 /*!
  * \brief Test write and read of file trees.
@@ -101,3 +106,110 @@ TEST_F(TextAndBackAgain, SimpleTree) {
   out << "01" << '\t' << "file1.txt" << std::endl;
   checkReadWrite(in.str(), out.str());
 }
+
+TEST_F(TextAndBackAgain, SeparatorOrder) {
+  std::ostringstream in;
+  in << "# ViFi@/example/dir" << std::endl;
+  in << "03" << '\t' << "dir-x" << std::endl;
+  in << "01" << '\t' << "dir" << std::endl;
+  in << "02" << '\t' << "dir/file.txt" << std::endl;
+  // Entries of a directory come before names extending its name.
+  std::ostringstream out;
+  out << "# ViFi@/example/dir" << std::endl;
+  out << "01" << '\t' << "dir" << std::endl;
+  out << "02" << '\t' << "dir/file.txt" << std::endl;
+  out << "03" << '\t' << "dir-x" << std::endl;
+  checkReadWrite(in.str(), out.str());
+}
+
+TEST_F(TextAndBackAgain, DuplicatePath) {
+  // Duplicates must be found in sorted and unsorted text alike.
+  for (const char *text : {"# ViFi@/dir\n01\tdir\n02\tdir/a\n03\tdir/a\n",
+                           "# ViFi@/dir\n02\tdir/a\n01\tdir\n03\tdir//a\n"}) {
+    std::istringstream in(text);
+    FileTree tree;
+    EXPECT_THROW(ReadText::read(in, tree), std::runtime_error);
+  }
+}
+
+TEST_F(TextAndBackAgain, InvalidLine) {
+  // Lines without tabulator or with invalid hex ids are rejected.
+  for (const char *line : {"01 file", "0\tfile", "zz\tfile", "0x1\tfile",
+                           "1 \tfile", "10000000000000000\tfile"}) {
+    std::istringstream in(std::string("# ViFi@/dir\n") + line + "\n");
+    FileTree tree;
+    EXPECT_THROW(ReadText::read(in, tree), std::runtime_error);
+  }
+}
+
+TEST_F(TextAndBackAgain, ParallelRead) {
+  // Several chunks of lines, the second half is unsorted.
+  std::ostringstream text;
+  text << "# ViFi@/example/dir" << std::endl;
+  for (int i = 0; i < 100000; ++i) {
+    int dir = i < 50000 ? i / 1000 : 149 - i / 1000;
+    text << std::hex << (2 * i + 1) << "\tdir" << std::dec << dir << "/file"
+         << i << std::endl;
+  }
+  for (int dir = 0; dir < 100; ++dir) {
+    text << std::hex << (2 * dir + 2) << "\tdir" << std::dec << dir
+         << std::endl;
+  }
+  std::istringstream serialIn(text.str());
+  FileTree serial;
+  ReadText::read(serialIn, serial);
+  std::istringstream parallelIn(text.str());
+  FileTree parallel;
+  ReadText::read(parallelIn, parallel, 4);
+  EXPECT_TRUE(serial == parallel);
+  // Errors name the same line number, even in a later chunk.
+  for (const char *line : {"x\tdir1/file1", "0\tdir1", "1\tdir7"}) {
+    std::string invalid = text.str() + line + "\n1\tdir2/file";
+    for (std::size_t threads : {1, 4}) {
+      std::istringstream in(invalid);
+      FileTree tree;
+      try {
+        ReadText::read(in, tree, threads);
+        ADD_FAILURE() << "No error for " << line;
+      } catch (const std::runtime_error &e) {
+        EXPECT_NE(std::string::npos,
+                  std::string(e.what()).find(" line 100102: "))
+            << e.what();
+      }
+    }
+  }
+}
+
+TEST_F(TextAndBackAgain, WideIds) {
+  std::ostringstream in;
+  in << "# ViFi@/example/dir" << std::endl;
+  in << "1" << '\t' << "dir" << std::endl;
+  in << "ABC" << '\t' << "dir/file1.txt" << std::endl;
+  in << "12345" << '\t' << "dir/file2.txt" << std::endl;
+  // Ids are padded to the byte width of the largest id.
+  std::ostringstream out;
+  out << "# ViFi@/example/dir" << std::endl;
+  out << "000001" << '\t' << "dir" << std::endl;
+  out << "000abc" << '\t' << "dir/file1.txt" << std::endl;
+  out << "012345" << '\t' << "dir/file2.txt" << std::endl;
+  checkReadWrite(in.str(), out.str());
+}
+
+TEST_F(TextAndBackAgain, ReadPipe) {
+  // A named pipe has no size to map, its content is read instead.
+  const std::string text = "# ViFi@/example/dir\n"
+                           "1\tdir\n"
+                           "2\tdir/file.txt\n";
+  fs::path pipe = fs::temp_directory_path() / "ViFiPipeTest";
+  fs::remove(pipe);
+  ASSERT_EQ(0, ::mkfifo(pipe.c_str(), 0600));
+  std::thread writer([&pipe, &text] { std::ofstream(pipe.string()) << text; });
+  FileTree piped;
+  EXPECT_NO_THROW(ReadText::read(pipe, piped));
+  writer.join();
+  fs::remove(pipe);
+  std::istringstream in(text);
+  FileTree tree;
+  ReadText::read(in, tree);
+  EXPECT_TRUE(piped == tree);
+}
@@ -0,0 +1,243 @@
+#include "ViFi/FileOpSequence.hpp"
+#include "ViFi/FileTree.hpp"
+#include "ViFi/ReadText.hpp"
+#include "ViFi/TreeView.hpp"
+#include "ViFi/WriteText.hpp"
+#include "gtest/gtest.h"
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+/*!
+ * \brief Test editing views of file trees.
+ * \see TreeView
+ */
+class TreeViews : public testing::Test {
+protected:
+  //! Original file tree in text format.
+  const std::string current = "# ViFi@/base\n"
+                              "01\tdirA\n"
+                              "02\tdirA/file.txt\n"
+                              "03\tdirA/sub\n"
+                              "04\tdirA/sub/file.txt\n"
+                              "05\tdirB\n"
+                              "06\tdirB/file.pdf\n"
+                              "07\tdirB/file.txt\n"
+                              "08\tfile.txt\n";
+
+  /*!
+   * \brief Read a file tree from text.
+   * \param tree File tree to load.
+   * \param text File tree in text format, see ReadText::read().
+   */
+  void readText(FileTree &tree, const std::string &text) {
+    std::istringstream in(text);
+    ReadText::read(in, tree);
+  }
+
+  /*!
+   * \brief Get the text of the original tree within a view.
+   * \param view View of the original tree.
+   * \return Text file as written by scan.
+   */
+  std::string viewText(const TreeView &view) {
+    FileTree tree;
+    readText(tree, current);
+    std::ostringstream out;
+    WriteText::write(tree, out, &view);
+    return out.str();
+  }
+
+  /*!
+   * \brief Plan the operations for a changed tree or view.
+   * \param view View the changed text is restricted to.
+   * \param changed Changed file tree or view in text format.
+   * \return Prepared file operations.
+   */
+  FileOpSequence plan(const TreeView &view, const std::string &changed) {
+    FileTree tree;
+    readText(tree, current);
+    tree.endOriginal();
+    readText(tree, changed);
+    view.keepOutside(tree);
+    tree.endTarget();
+    FileOpSequence sequence;
+    tree.generate(sequence);
+    sequence.prepare();
+    return sequence;
+  }
+
+  /*!
+   * \brief Check that an edited view plans the same as the full edit.
+   * \param view View the changed text is restricted to.
+   * \param changedView Edited view in text format.
+   * \param changed Same edit of the whole tree in text format.
+   */
+  void checkEdit(const TreeView &view, const std::string &changedView,
+                 const std::string &changed) {
+    FileOpSequence viewOps = plan(view, changedView);
+    FileOpSequence fullOps = plan(TreeView(), changed);
+    EXPECT_FALSE(fullOps.empty());
+    EXPECT_TRUE(viewOps == fullOps);
+  }
+};
+
+TEST_F(TreeViews, SubtreeText) {
+  TreeView view;
+  view.setSubtree("dirA/sub/");
+  EXPECT_EQ("# ViFi@/base\n"
+            "03\tdirA/sub\n"
+            "04\tdirA/sub/file.txt\n",
+            viewText(view));
+  // An unchanged view plans no operations.
+  EXPECT_TRUE(plan(view, viewText(view)).empty());
+}
+
+TEST_F(TreeViews, SubtreeEdit) {
+  TreeView view;
+  view.setSubtree("dirA");
+  // Rename within the view, move an entry out of the view, drop another.
+  checkEdit(view,
+            "# ViFi@/base\n"
+            "01\tdirA\n"
+            "03\tdirA/other\n"
+            "04\tdirA/other/file.txt\n"
+            "02\tdirC/file.txt\n",
+            "# ViFi@/base\n"
+            "01\tdirA\n"
+            "03\tdirA/other\n"
+            "04\tdirA/other/file.txt\n"
+            "05\tdirB\n"
+            "06\tdirB/file.pdf\n"
+            "07\tdirB/file.txt\n"
+            "02\tdirC/file.txt\n"
+            "08\tfile.txt\n");
+}
+
+TEST_F(TreeViews, MatchEdit) {
+  TreeView view;
+  view.setMatch("\\.txt$");
+  EXPECT_EQ("# ViFi@/base\n"
+            "02\tdirA/file.txt\n"
+            "04\tdirA/sub/file.txt\n"
+            "07\tdirB/file.txt\n"
+            "08\tfile.txt\n",
+            viewText(view));
+  // Swap two files and remove another, directories stay in place.
+  checkEdit(view,
+            "# ViFi@/base\n"
+            "04\tdirA/file.txt\n"
+            "02\tdirA/sub/file.txt\n"
+            "08\tfile.txt\n",
+            "# ViFi@/base\n"
+            "01\tdirA\n"
+            "04\tdirA/file.txt\n"
+            "03\tdirA/sub\n"
+            "02\tdirA/sub/file.txt\n"
+            "05\tdirB\n"
+            "06\tdirB/file.pdf\n"
+            "08\tfile.txt\n");
+}
+
+TEST_F(TreeViews, MatchDirectory) {
+  TreeView view;
+  view.setMatch("^dirA$");
+  // A matched directory shows everything below it.
+  EXPECT_EQ("# ViFi@/base\n"
+            "01\tdirA\n"
+            "02\tdirA/file.txt\n"
+            "03\tdirA/sub\n"
+            "04\tdirA/sub/file.txt\n",
+            viewText(view));
+  // Removing the directory line leaves the entries below it in place.
+  checkEdit(view,
+            "# ViFi@/base\n"
+            "02\tdirA/file.txt\n"
+            "03\tdirA/sub\n"
+            "04\tdirA/sub/file.txt\n",
+            "# ViFi@/base\n"
+            "02\tdirA/file.txt\n"
+            "03\tdirA/sub\n"
+            "04\tdirA/sub/file.txt\n"
+            "05\tdirB\n"
+            "06\tdirB/file.pdf\n"
+            "07\tdirB/file.txt\n"
+            "08\tfile.txt\n");
+  // Renaming the directory only moves what the view shows.
+  checkEdit(view,
+            "# ViFi@/base\n"
+            "01\tdirZ\n"
+            "02\tdirZ/file.txt\n"
+            "03\tdirZ/sub\n"
+            "04\tdirZ/sub/file.txt\n",
+            "# ViFi@/base\n"
+            "05\tdirB\n"
+            "06\tdirB/file.pdf\n"
+            "07\tdirB/file.txt\n"
+            "01\tdirZ\n"
+            "02\tdirZ/file.txt\n"
+            "03\tdirZ/sub\n"
+            "04\tdirZ/sub/file.txt\n"
+            "08\tfile.txt\n");
+}
+
+TEST_F(TreeViews, PathOutsideInUse) {
+  TreeView view;
+  view.setSubtree("dirA");
+  // The path of an entry outside the view cannot take an entry of the view.
+  EXPECT_THROW(plan(view, "# ViFi@/base\n"
+                          "01\tdirA\n"
+                          "02\tdirB/file.pdf\n"),
+               std::runtime_error);
+}
+
+TEST_F(TreeViews, DeepTree) {
+  // Close to the maximum depth, without running out of stack.
+  FileTree tree;
+  tree.setBasePath("/base");
+  const FileTree::Node *dir = tree.baseNode();
+  for (FileTree::Id id = 1; id <= 60000; ++id) {
+    dir = tree.addEntry(dir, id, "dir");
+  }
+  tree.endOriginal();
+  // An empty view keeps every entry outside of it in place.
+  TreeView view;
+  view.setSubtree("other");
+  tree.setBasePath("/base");
+  view.keepOutside(tree);
+  tree.endTarget();
+  FileOpSequence sequence;
+  tree.generate(sequence);
+  sequence.prepare();
+  EXPECT_TRUE(sequence.empty());
+}
+
+TEST_F(TreeViews, DeepSubtreeText) {
+  // Close to the maximum depth, without running out of stack.
+  FileTree tree;
+  tree.setBasePath("/base");
+  const FileTree::Node *dir = tree.baseNode();
+  std::string path = "d";
+  for (FileTree::Id id = 1; id <= 60000; ++id) {
+    dir = tree.addEntry(dir, id, "d");
+    if (id > 1) {
+      path += "/d";
+    }
+  }
+  // Only the deepest entry is in the view.
+  TreeView view;
+  view.setSubtree(path);
+  std::ostringstream out;
+  WriteText::write(tree, out, &view);
+  EXPECT_EQ("# ViFi@/base\nea60\t" + path + "\n", out.str());
+}
+
+TEST_F(TreeViews, InvalidViews) {
+  TreeView view;
+  EXPECT_TRUE(view.whole());
+  EXPECT_THROW(view.setSubtree("/base/dirA"), std::runtime_error);
+  EXPECT_THROW(view.setSubtree("dirA/../.."), std::runtime_error);
+  EXPECT_THROW(view.setSubtree("."), std::runtime_error);
+  EXPECT_THROW(view.setMatch("(dirA"), std::runtime_error);
+  EXPECT_TRUE(view.whole());
+}
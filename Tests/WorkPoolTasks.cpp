@@ -0,0 +1,56 @@
+#include "ViFi/WorkPool.hpp"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <functional>
+#include <stdexcept>
+
+/*!
+ * \brief Test running tasks that push further tasks on a work pool.
+ * \see WorkPool
+ */
+class WorkPoolTasks : public testing::Test {
+protected:
+  /*!
+   * \brief Push a task that pushes a binary tree of subtasks.
+   * \param pool Work pool to run the tasks on.
+   * \param depth Levels of subtasks below the task.
+   * \param done Counts the finished tasks.
+   */
+  void pushTree(WorkPool &pool, int depth, std::atomic<int> &done) {
+    pool.push([this, &pool, depth, &done] {
+      if (depth > 0) {
+        pushTree(pool, depth - 1, done);
+        pushTree(pool, depth - 1, done);
+      }
+      ++done;
+    });
+  }
+};
+
+TEST_F(WorkPoolTasks, NestedTasks) {
+  // Idle workers steal subtasks as soon as they are pushed, wait() must not
+  // return before the whole tree of tasks is done.
+  for (std::size_t threads : {1, 2, 4, 8}) {
+    WorkPool pool(threads);
+    for (int round = 0; round < 200; ++round) {
+      std::atomic<int> done(0);
+      pushTree(pool, 8, done);
+      pool.wait();
+      ASSERT_EQ((1 << 9) - 1, done.load()) << threads << " threads";
+    }
+  }
+}
+
+TEST_F(WorkPoolTasks, FailingTask) {
+  WorkPool pool(4);
+  std::atomic<int> done(0);
+  pool.push([&pool, &done] {
+    pool.push([] { throw std::runtime_error("Task failed."); });
+    ++done;
+  });
+  EXPECT_THROW(pool.wait(), std::runtime_error);
+  // The pool stays usable after a failure.
+  pushTree(pool, 4, done);
+  pool.wait();
+  EXPECT_EQ(1 + (1 << 5) - 1, done.load());
+}
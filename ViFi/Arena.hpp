@@ -0,0 +1,136 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*!
+ * \class Arena Arena.hpp "ViFi/Arena.hpp"
+ * \brief Allocates objects of one type contiguously in large blocks.
+ *
+ * Objects are placed one after another into blocks of fixed size, which
+ * avoids one heap allocation per object and keeps objects created in sequence
+ * close in memory. Objects cannot be released individually, they stay at the
+ * same address until all of them are released at once by clear().
+ *
+ * The object type may be incomplete where the arena is declared, it only
+ * needs to be complete where the member functions are used.
+ *
+ * \tparam T Type of the allocated objects.
+ */
+template <typename T> class Arena {
+public:
+  //! Number of objects per block.
+  static constexpr std::size_t BLOCK_SIZE = 4096;
+
+  Arena() : _size(0) {}  //!< Create an empty arena.
+  ~Arena() { clear(); } //!< Release all objects.
+
+  Arena(const Arena &) = delete;            //!< Not copyable.
+  Arena &operator=(const Arena &) = delete; //!< Not copyable.
+
+  /*!
+   * \brief Construct a new object in the arena.
+   * \param args Arguments passed to the constructor of the object.
+   * \return Pointer to the object, valid until clear() is called.
+   */
+  template <typename... Args> T *create(Args &&...args) {
+    T *object = new (reserve(1)) T(std::forward<Args>(args)...);
+    ++_blocks.back().used;
+    ++_size;
+    return object;
+  }
+
+  /*!
+   * \brief Construct an array of consecutive objects in the arena.
+   * \param count Number of objects in the array.
+   * \param value Initial value of all objects.
+   * \return Pointer to the first object, valid until clear() is called.
+   */
+  T *createArray(std::size_t count, const T &value) {
+    T *array = reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      new (array + i) T(value);
+      ++_blocks.back().used;
+      ++_size;
+    }
+    return array;
+  }
+
+  /*!
+   * \brief Get an object by its position in creation order.
+   *
+   * Only valid if all objects were constructed through create(), which fills
+   * every block completely before starting the next one.
+   * \param index Position of the object, less than size().
+   * \return Reference to the object.
+   */
+  T &operator[](std::size_t index) {
+    return static_cast<T *>(
+        _blocks[index / BLOCK_SIZE].data)[index % BLOCK_SIZE];
+  }
+
+  /*!
+   * \brief Get a constant object by its position in creation order.
+   * \param index Position of the object, less than size().
+   * \return Constant reference to the object.
+   */
+  const T &operator[](std::size_t index) const {
+    return static_cast<const T *>(
+        _blocks[index / BLOCK_SIZE].data)[index % BLOCK_SIZE];
+  }
+
+  /*!
+   * \brief Get the number of objects in the arena.
+   */
+  std::size_t size() const { return _size; }
+
+  /*!
+   * \brief Destroy all objects and release the memory blocks.
+   *
+   * Trivially destructible objects are released without touching them.
+   */
+  void clear() noexcept {
+    if constexpr (!std::is_trivially_destructible<T>::value) {
+      for (const Block &block : _blocks) {
+        T *objects = static_cast<T *>(block.data);
+        for (std::size_t i = 0; i < block.used; ++i) {
+          objects[i].~T();
+        }
+      }
+    }
+    for (const Block &block : _blocks) {
+      ::operator delete(block.data);
+    }
+    _blocks.clear();
+    _size = 0;
+  }
+
+private:
+  // Memory block holding consecutive objects.
+  struct Block {
+    void *data;           // Storage of the objects.
+    std::size_t used;     // Number of objects constructed.
+    std::size_t capacity; // Number of objects that fit.
+  };
+
+  // Get space for consecutive objects, starting a new block if necessary.
+  T *reserve(std::size_t count) {
+    if (_blocks.empty() ||
+        _blocks.back().capacity - _blocks.back().used < count) {
+      std::size_t capacity = std::max(count, BLOCK_SIZE);
+      _blocks.reserve(_blocks.size() + 1);
+      _blocks.push_back({::operator new(capacity * sizeof(T)), 0, capacity});
+    }
+    return static_cast<T *>(_blocks.back().data) + _blocks.back().used;
+  }
+
+  std::vector<Block> _blocks; // Memory blocks, only the last one has space.
+  std::size_t _size;          // Number of objects.
+};
+
+#endif // ARENA_HPP
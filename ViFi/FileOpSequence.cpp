@@ -5,6 +5,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <utility>
 
 namespace {
 
@@ -52,18 +53,20 @@ void FileOpSequence::setMaxEntryId(Id id) {
   _maxEntry = std::max(_maxEntry, id);
 }
 
-void FileOpSequence::addOutOp(Id entryId, const fs::path &path, bool keep,
+void FileOpSequence::addOutOp(Id entryId, fs::path path, bool keep,
                               Level level, Level pivot, int copies) {
   Type type = keep ? CopyOut : MoveOut;
-  Operation *op = new Operation({type, entryId, path, level, pivot, copies});
+  Operation *op =
+      new Operation({type, entryId, std::move(path), level, pivot, copies});
   _operations.push_back(op);
   setMaxEntryId(entryId);
 }
 
-void FileOpSequence::addInOp(Id entryId, const fs::path &path, bool create,
+void FileOpSequence::addInOp(Id entryId, fs::path path, bool create,
                              Level level, Level pivot) {
   int copies = create ? 0 : 1;
-  Operation *op = new Operation({CopyIn, entryId, path, level, pivot, copies});
+  Operation *op =
+      new Operation({CopyIn, entryId, std::move(path), level, pivot, copies});
   _operations.push_back(op);
   setMaxEntryId(entryId);
 }
@@ -43,7 +43,7 @@ public:
    * \param pivot Pivot value for sorting, if different from level.
    * \param copies Total number of copies to be made.
    */
-  void addOutOp(Id entryId, const fs::path &path, bool keep, Level level,
+  void addOutOp(Id entryId, fs::path path, bool keep, Level level,
                 Level pivot, int copies);
 
   /*!
@@ -54,7 +54,7 @@ public:
    * \param level Relative directory level of the target.
    * \param pivot Level of first path difference from original.
    */
-  void addInOp(Id entryId, const fs::path &path, bool create, Level level,
+  void addInOp(Id entryId, fs::path path, bool create, Level level,
                Level pivot);
 
   /*!
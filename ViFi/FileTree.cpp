@@ -1,183 +1,527 @@
 #include "ViFi/FileTree.hpp"
 #include "ViFi/FileOpSequence.hpp"
+#include "ViFi/MappedFile.hpp"
+#include "ViFi/WorkPool.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 namespace {
 // Maximum directory level, used as pivot for unchanged paths.
-constexpr FileTree::Level MAX_LEVEL =
-    std::numeric_limits<FileTree::Level>::max();
+constexpr std::uint16_t MAX_LEVEL = std::numeric_limits<std::uint16_t>::max();
 // Entry id of the root directory.
-constexpr FileTree::Id ROOT_ID = 0;
+constexpr std::uint32_t ROOT_ID = 0;
 // Maximum valid entry id.
-constexpr FileTree::Id MAX_ID = std::numeric_limits<FileTree::Id>::max() - 2;
+constexpr std::uint32_t MAX_ID = std::numeric_limits<std::uint32_t>::max() - 2;
 // Check for a valid entry id.
 constexpr bool isValidId(FileTree::Id id) { return id <= MAX_ID; }
 // Invalid entry id that stands for a non-existing (removed) entry.
-constexpr FileTree::Id NONE_ID = MAX_ID + 1;
+constexpr std::uint32_t NONE_ID = MAX_ID + 1;
 // Invalid entry id that stands for a newly created directory.
-constexpr FileTree::Id CREATE_DIR = MAX_ID + 2;
+constexpr std::uint32_t CREATE_DIR = MAX_ID + 2;
+// Invalid slot that stands for a missing node.
+constexpr std::uint32_t NO_SLOT = std::numeric_limits<std::uint32_t>::max();
+// Hash of a directory entry for the lookup table, by parent slot and name.
+std::size_t lookupHash(std::uint32_t dir, std::string_view name) {
+  return std::hash<std::string_view>()(name) ^
+         (dir * static_cast<std::size_t>(0x9e3779b97f4a7c15ULL));
+}
+// Size of a lookup table for a number of slots, keeps it at most half full
+// for short probe sequences.
+std::size_t lookupSize(std::size_t slots) {
+  std::size_t size = 1;
+  while (size < 2 * slots) {
+    size *= 2;
+  }
+  return size;
+}
+// Insert a slot into a lookup table, probing linearly for an empty bucket.
+void insertLookup(std::vector<std::uint32_t> &lookup, std::uint32_t slot,
+                  std::uint32_t dir, std::string_view name) {
+  std::size_t mask = lookup.size() - 1;
+  std::size_t i = lookupHash(dir, name) & mask;
+  while (lookup[i] != NO_SLOT) {
+    i = (i + 1) & mask;
+  }
+  lookup[i] = slot;
+}
+// Key of an intermediate directory request by slot and pivot level, sorts by
+// slot first and then by descending pivot.
+std::uint64_t requestKey(std::uint32_t slot, std::size_t pvt) {
+  return (static_cast<std::uint64_t>(slot) << 16) | (MAX_LEVEL - pvt);
+}
+// Convert a stored entry name to a filesystem path.
+fs::path toPath(std::string_view name) {
+  return fs::path(name.begin(), name.end());
+}
 } // namespace
 
 /*!
- * \brief Internal data to store a file tree node.
+ * \brief Data to store the entry change of a file tree node.
  */
-struct FileTree::Node {
-  /*!
-   * \brief Complete Node constructor with "unchanged" default pivot.
-   */
-  Node(const Node *_dir, Id _entry, Id _target, fs::path _name, Level _level,
-       Level _pivot = MAX_LEVEL)
-      : dir(_dir), entry(_entry), target(_target), name(std::move(_name)),
-        level(_level), pivot(_pivot) {}
+struct FileTree::Move {
+  EntryLvl pivot; //!< Pivot level of the change.
+  EntryId from;   //!< Entry id before the change.
+  EntryId to;     //!< Entry id after the change.
+};
 
+/*!
+ * \brief Handle of a file tree node, the planning data is kept by the tree.
+ */
+struct FileTree::Node {
   /*!
-   * \brief Construct temporary Node for search comparison.
+   * \brief Complete Node constructor, also used for search comparison.
    */
-  Node(const Node *_dir, fs::path _name = fs::path())
-      : dir(_dir), entry(NONE_ID), target(NONE_ID), name(std::move(_name)),
-        level(0), pivot(MAX_LEVEL) {}
+  Node(const Node *_dir, std::string_view _name = std::string_view(),
+       EntryId _entry = NONE_ID, Slot _slot = NO_SLOT)
+      : dir(_dir), name(_name), entry(_entry), slot(_slot) {}
 
   const Node *dir; //!< Pointer to parent directory node.
-  Id entry;        //!< Id of the directory entry, a file or also a directory.
-  Id target;       //!< Target Id of the directory entry.
-  fs::path name;   //!< Entry name in the directory.
-  Level level;     //!< Directory depth level in the file tree.
-  Level pivot;     //!< Level of first path difference for target.
+  //! Entry name in the directory, stored in the NamePool of the tree.
+  std::string_view name;
+  EntryId entry; //!< Id of the directory entry, a file or also a directory.
+  Slot slot;     //!< Position of the node in the node arrays of the tree.
 
   /*!
-   * \brief Data to store the entry change of a file tree node.
+   * \brief Reassemble the filesystem path of the file tree node.
+   * \return Filesystem path of this file tree node.
    */
-  struct Move {
-    Id from; //!< Entry id before the change.
-    Id to;   //!< Entry id after the change.
-  };
-
-  std::vector<Move> moves; //!< Stores one move per pivot, which level moves.
+  [[nodiscard]] fs::path path() const {
+    if (dir && dir != this) {
+      return dir->path() / toPath(name);
+    } else {
+      return toPath(name);
+    }
+  }
+};
 
-  /*!
-   * \brief Get the move data for given pivot.
-   * \param pvt Pivot level, corresponding to execution level.
-   * \return Move reference for given pivot.
-   */
-  Move &move(Level pvt) { return moves[moves.size() - pvt]; }
+/*!
+ * \brief Entries of all directories in compressed sparse row layout.
+ */
+struct FileTree::ChildIndex {
+  //! Offset of the entries of each slot in nodes, one extra for the end.
+  std::vector<Slot> begin;
+  //! Entry nodes grouped by directory slot, sorted by name in each group.
+  std::vector<const Node *> nodes;
+};
 
+namespace {
+/*!
+ * \brief Answers level ancestor queries on the slots of a file tree.
+ *
+ * Every slot gets one jump pointer to an ancestor, chosen by the skew-binary
+ * scheme of Myers: the jump distances of a path follow the skew-binary digits
+ * of the level. The ancestor at any level is then reached in O(log depth)
+ * steps, and the pointers are built in a single pass over the slots.
+ */
+class LevelAncestors {
+public:
   /*!
-   * \brief Get the constant move data for given pivot.
-   * \param pvt Pivot level, corresponding to execution level.
-   * \return Constant move reference for given pivot.
+   * \brief Build the jump pointers of a file tree.
+   * \param dirs Slot of the parent directory, by slot. Root is slot 0.
+   * \param levels Directory level, by slot.
    */
-  [[nodiscard]] const Move &move(Level pvt) const {
-    return moves.at(moves.size() - pvt);
+  LevelAncestors(const std::vector<std::uint32_t> &dirs,
+                 const std::vector<std::uint16_t> &levels)
+      : _dirs(dirs), _levels(levels), _jumps(dirs.size(), 0) {
+    // Parent directories come before their entries in slot order.
+    for (std::size_t slot = 1; slot < _jumps.size(); ++slot) {
+      std::uint32_t parent = _dirs[slot];
+      std::uint32_t jump = _jumps[parent];
+      if (_levels[parent] - _levels[jump] ==
+          _levels[jump] - _levels[_jumps[jump]]) {
+        _jumps[slot] = _jumps[jump];
+      } else {
+        _jumps[slot] = parent;
+      }
+    }
   }
 
   /*!
-   * \brief Reassemble the filesystem path of the file tree node.
-   * \return Filesystem path of this file tree node.
+   * \brief Get the ancestor of a slot at given level.
+   * \param slot Slot to start from.
+   * \param level Directory level, not greater than the level of slot.
+   * \return Ancestor slot at given level.
    */
-  [[nodiscard]] fs::path path() const {
-    if (dir && dir != this) {
-      return dir->path() / name;
-    } else {
-      return name;
+  std::uint32_t ancestor(std::uint32_t slot, FileTree::Level level) const {
+    while (_levels[slot] > level) {
+      slot = (_levels[_jumps[slot]] >= level) ? _jumps[slot] : _dirs[slot];
     }
+    return slot;
   }
 
   /*!
-   * \brief Equality comparison.
-   * \param other File tree node to compare this to.
-   * \return True if both nodes are equal.
+   * \brief Compute the directory level where the paths of two slots diverge.
+   *
+   * Entries of a directory have distinct names, so the paths differ at the
+   * level below their deepest common ancestor, or where the shorter one ends.
+   * \param slotA Slot of the first path.
+   * \param slotB Slot of the second path.
+   * \return First level of path difference, MAX_LEVEL for equal paths.
    */
-  bool operator==(const Node &other) const {
-    return dir->entry == other.dir->entry && entry == other.entry &&
-           target == other.target && name == other.name && level == other.level;
+  FileTree::Level pivot(std::uint32_t slotA, std::uint32_t slotB) const {
+    FileTree::Level result = MAX_LEVEL;
+    if (_levels[slotA] > _levels[slotB]) {
+      result = _levels[slotB];
+      slotA = ancestor(slotA, result);
+    } else if (_levels[slotA] < _levels[slotB]) {
+      result = _levels[slotA];
+      slotB = ancestor(slotB, result);
+    }
+    if (slotA != slotB) {
+      // Climb to the entries of the deepest common ancestor. Jump pointers
+      // depend only on the level, so both sides jump the same distance.
+      while (_dirs[slotA] != _dirs[slotB]) {
+        if (_jumps[slotA] != _jumps[slotB]) {
+          slotA = _jumps[slotA];
+          slotB = _jumps[slotB];
+        } else {
+          slotA = _dirs[slotA];
+          slotB = _dirs[slotB];
+        }
+      }
+      result = std::min<FileTree::Level>(result, _levels[slotA]);
+    }
+    return result;
   }
+
+private:
+  const std::vector<std::uint32_t> &_dirs;   // Parent directory by slot.
+  const std::vector<std::uint16_t> &_levels; // Directory level by slot.
+  std::vector<std::uint32_t> _jumps;         // Jump pointer by slot.
 };
 
-namespace {
-// Compute the directory level where the path of two entry nodes diverge.
-FileTree::Level pivot(const FileTree::Node *nodeA,
-                      const FileTree::Node *nodeB) {
-  FileTree::Level result = 0;
-  if (nodeA && nodeB) {
-    const FileTree::Node *nextA = nodeA->dir;
-    const FileTree::Node *nextB = nodeB->dir;
-    if (nodeA->level > nodeB->level) {
-      nextB = nodeB;
-      result = nodeB->level;
-    } else if (nodeA->level < nodeB->level) {
-      nextA = nodeA;
-      result = nodeA->level;
-    } else {
-      result = (nodeA->name != nodeB->name) ? nodeA->level : MAX_LEVEL;
+/*!
+ * \brief Run a function for all slots except root, parent directories first.
+ *
+ * Without a work pool, the slots are visited in slot order. Otherwise they are
+ * visited level by level, with the slots of each level split into chunks that
+ * run on the pool. A level only starts when the previous one is done.
+ * \param levels Directory level, by slot.
+ * \param pool Work pool to run the function on, null to run it serially.
+ * \param minChunk Minimum number of slots planned by one task of the pool.
+ * \param function Function called with each slot.
+ */
+template <typename Function>
+void forEachSlot(const std::vector<std::uint16_t> &levels, WorkPool *pool,
+                 std::size_t minChunk, Function function) {
+  if (!pool) {
+    for (std::uint32_t slot = 1; slot < levels.size(); ++slot) {
+      function(slot);
     }
-    if (nextA != nodeA || nextB != nodeB) {
-      result = std::min(result, pivot(nextA, nextB));
+    return;
+  }
+  // Sort the slots by level, begin[level] is the offset of the level.
+  std::vector<std::size_t> begin(MAX_LEVEL + 2, 0);
+  for (std::uint32_t slot = 1; slot < levels.size(); ++slot) {
+    ++begin[levels[slot] + 1];
+  }
+  for (std::size_t i = 1; i < begin.size(); ++i) {
+    begin[i] += begin[i - 1];
+  }
+  std::vector<std::uint32_t> order(levels.size() - 1);
+  std::vector<std::size_t> next(begin.begin(), begin.end() - 1);
+  for (std::uint32_t slot = 1; slot < levels.size(); ++slot) {
+    order[next[levels[slot]]++] = slot;
+  }
+  // A few tasks per thread balance the load without much overhead.
+  std::size_t chunk = std::max(minChunk, order.size() / (4 * pool->threads()));
+  for (std::size_t level = 1; begin[level] < order.size(); ++level) {
+    std::size_t end = begin[level + 1];
+    if (end - begin[level] <= chunk) {
+      // Small levels are not worth the synchronization.
+      for (std::size_t i = begin[level]; i < end; ++i) {
+        function(order[i]);
+      }
+      continue;
+    }
+    for (std::size_t first = begin[level]; first < end; first += chunk) {
+      std::size_t last = std::min(end, first + chunk);
+      pool->push([&order, &function, first, last]() {
+        for (std::size_t i = first; i < last; ++i) {
+          function(order[i]);
+        }
+      });
     }
+    pool->wait();
   }
-  return result;
 }
 
-// Less than comparison for the directory of referenced nodes.
-bool lessDir(const FileTree::Node *nodeA, const FileTree::Node *nodeB) {
-  return nodeA->dir->entry < nodeB->dir->entry;
+// Less than comparison for the name of referenced nodes.
+bool lessName(const FileTree::Node *nodeA, const FileTree::Node *nodeB) {
+  return nodeA->name < nodeB->name;
+}
+
+// Identifies the snapshot file format.
+const char SNAPSHOT_MAGIC[16] = "ViFiSnapshot3\n";
+
+/*
+ * Header of a snapshot file. It is followed by these sections, each padded to
+ * a multiple of 8 bytes:
+ * - Name characters, the root name first, then each distinct entry name.
+ * - Offset of the name in the name characters, 64-bit by slot.
+ * - Size of the name, 32-bit by slot.
+ * - Slot of the parent directory, 32-bit by slot.
+ * - Entry id, 32-bit by slot.
+ * - Directory level, 16-bit by slot.
+ * All values are stored in native byte order. The lookup table is rebuilt on
+ * loading, which also rejects duplicate names within a directory.
+ */
+struct SnapshotHeader {
+  char magic[16];      // Equal to SNAPSHOT_MAGIC.
+  std::uint64_t slots; // Number of nodes including root.
+  std::uint64_t chars; // Number of name characters.
+  std::uint64_t root;  // Size of the root name.
+  std::uint64_t size;  // Size of the text file of the tree.
+  std::int64_t time;   // Modification time of the text file.
+};
+
+// Get size and modification time of the text file a snapshot belongs to.
+bool textStamp(const fs::path &text, std::uint64_t &size, std::int64_t &time) {
+  std::error_code error;
+  size = fs::file_size(text, error);
+  if (!error) {
+    time = static_cast<std::int64_t>(
+        fs::last_write_time(text, error).time_since_epoch().count());
+  }
+  return !error;
 }
 
-// Less than comparison for directory and name of referenced nodes.
-bool lessDirName(const FileTree::Node *nodeA, const FileTree::Node *nodeB) {
-  return nodeA->dir->entry < nodeB->dir->entry ||
-         (nodeA->dir->entry == nodeB->dir->entry && nodeA->name < nodeB->name);
+// Write the values of a section, padded to a multiple of 8 bytes.
+template <typename T>
+void writeSection(std::ostream &out, const T *values, std::size_t count) {
+  static const char padding[8] = {};
+  std::size_t bytes = count * sizeof(T);
+  out.write(reinterpret_cast<const char *>(values),
+            static_cast<std::streamsize>(bytes));
+  out.write(padding, static_cast<std::streamsize>((8 - bytes % 8) % 8));
+}
+
+// Take the next section of a mapped snapshot, null if the data is too short.
+template <typename T>
+const T *readSection(const MappedFile &mapped, std::size_t &offset,
+                     std::size_t count) {
+  if (offset > mapped.size() || count > (mapped.size() - offset) / sizeof(T)) {
+    return nullptr;
+  }
+  const char *section = mapped.data() + offset;
+  std::size_t bytes = count * sizeof(T);
+  offset = std::min(mapped.size(), offset + bytes + (8 - bytes % 8) % 8);
+  return reinterpret_cast<const T *>(section);
 }
 } // namespace
 
 fs::path FileTree::name(const FileTree::Node *entry) {
   if (entry) {
-    return entry->name;
+    return toPath(entry->name);
   } else {
     return fs::path();
   }
 }
 
 FileTree::FileTree()
-    : _root(new Node(nullptr, ROOT_ID, ROOT_ID, fs::path(), 0)),
-      _original(true), _index(new std::vector<Node *>()) {
-  _root->dir = _root;
+    : _root(new Node(nullptr)), _original(true),
+      _children(new ChildIndex()) {
   clear();
 }
 
 FileTree::~FileTree() {
   clear();
   delete _root;
-  delete _index;
+  delete _children;
 }
 
 void FileTree::endOriginal() {
   for (Id id = 0; id < _byId.size(); ++id) {
-    const Node *node = _byId.at(id);
-    if (!node) {
+    Slot slot = _byId.at(id);
+    if (slot == NO_SLOT) {
       throw std::runtime_error("Missing entry from original tree.");
-    } else if (node->entry != id) {
+    } else if (_entries.at(slot) != id) {
       throw std::runtime_error("Invalid entry id in original tree.");
     }
   }
   _original = false;
-  // Create index of original file tree.
-  index();
+  // Create lookup table of original file tree.
+  buildLookup(1);
 }
 
-void FileTree::endTarget() {
-  computePivots();
-  computeMoves();
+void FileTree::saveSnapshot(const fs::path &file,
+                            const fs::path &text) const {
+  if (_original || _levels.size() != _byId.size()) {
+    throw std::runtime_error(
+        "Snapshot requires an original tree finished by endOriginal().");
+  }
+  // Number the nodes in path order, like ReadText adds them from text.
+  std::vector<Slot> order = {0};
+  std::vector<Slot> renumber(_levels.size(), 0);
+  order.reserve(_levels.size());
+  std::vector<Range> stack = {entries(_root)};
+  while (!stack.empty()) {
+    if (stack.back().begin == stack.back().end) {
+      stack.pop_back();
+      continue;
+    }
+    const Node *sub = *(stack.back().begin++);
+    renumber[sub->slot] = static_cast<Slot>(order.size());
+    order.push_back(sub->slot);
+    stack.push_back(entries(sub));
+  }
+  // Collect the node arrays in that order, with each distinct name once.
+  std::string chars(_root->name);
+  std::unordered_map<std::string_view, std::uint64_t> offsets;
+  std::vector<std::uint64_t> nameOffsets(order.size(), 0);
+  std::vector<std::uint32_t> nameSizes(order.size(), 0);
+  std::vector<Slot> dirs(order.size(), 0);
+  std::vector<EntryId> entries(order.size(), ROOT_ID);
+  std::vector<EntryLvl> levels(order.size(), 0);
+  for (Slot slot = 1; slot < order.size(); ++slot) {
+    Slot former = order[slot];
+    std::string_view name = node(former)->name;
+    auto found = offsets.emplace(name, chars.size());
+    if (found.second) {
+      chars.append(name);
+    }
+    nameOffsets[slot] = found.first->second;
+    nameSizes[slot] = static_cast<std::uint32_t>(name.size());
+    dirs[slot] = renumber[_dirs[former]];
+    entries[slot] = _entries[former];
+    levels[slot] = _levels[former];
+  }
+  // Write header and sections.
+  SnapshotHeader header = {};
+  std::copy(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC),
+            std::begin(header.magic));
+  header.slots = order.size();
+  header.chars = chars.size();
+  header.root = _root->name.size();
+  if (!textStamp(text, header.size, header.time)) {
+    throw std::runtime_error("Unable to read text file " + text.string());
+  }
+  std::ofstream out(file.string(), std::ios_base::out | std::ios_base::trunc |
+                                       std::ios_base::binary);
+  if (!out.is_open()) {
+    throw std::runtime_error("Unable to write snapshot " + file.string());
+  }
+  writeSection(out, &header, 1);
+  writeSection(out, chars.data(), chars.size());
+  writeSection(out, nameOffsets.data(), nameOffsets.size());
+  writeSection(out, nameSizes.data(), nameSizes.size());
+  writeSection(out, dirs.data(), dirs.size());
+  writeSection(out, entries.data(), entries.size());
+  writeSection(out, levels.data(), levels.size());
+  if (!out.flush()) {
+    throw std::runtime_error("Unable to write snapshot " + file.string());
+  }
 }
 
-fs::path FileTree::basePath() const { return _root->name; }
+bool FileTree::loadSnapshot(const fs::path &file, const fs::path &text) {
+  clear();
+  std::unique_ptr<MappedFile> mapped;
+  try {
+    mapped = std::make_unique<MappedFile>(file);
+  } catch (const fs::filesystem_error &) {
+    return false;
+  }
+  // Locate the sections behind a valid header, written for the unchanged
+  // text file.
+  std::uint64_t size = 0;
+  std::int64_t time = 0;
+  std::size_t offset = 0;
+  const auto *header = readSection<SnapshotHeader>(*mapped, offset, 1);
+  if (!header || !textStamp(text, size, time) || header->size != size ||
+      header->time != time ||
+      !std::equal(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC),
+                  std::begin(header->magic)) ||
+      header->slots < 1 || header->slots >= NO_SLOT ||
+      header->root > header->chars) {
+    return false;
+  }
+  std::size_t slots = header->slots;
+  const auto *chars = readSection<char>(*mapped, offset, header->chars);
+  const auto *nameOffsets = readSection<std::uint64_t>(*mapped, offset, slots);
+  const auto *nameSizes = readSection<std::uint32_t>(*mapped, offset, slots);
+  const auto *dirs = readSection<Slot>(*mapped, offset, slots);
+  const auto *entries = readSection<EntryId>(*mapped, offset, slots);
+  const auto *levels = readSection<EntryLvl>(*mapped, offset, slots);
+  if (!chars || !nameOffsets || !nameSizes || !dirs || !entries || !levels ||
+      dirs[0] != 0 || entries[0] != ROOT_ID || levels[0] != 0) {
+    return false;
+  }
+  // Check that parents come first and every entry id is used once.
+  std::vector<Slot> byId(slots, NO_SLOT);
+  byId[ROOT_ID] = 0;
+  for (Slot slot = 1; slot < slots; ++slot) {
+    if (dirs[slot] >= slot || levels[slot] != levels[dirs[slot]] + 1 ||
+        levels[slot] >= MAX_LEVEL || entries[slot] >= slots ||
+        byId[entries[slot]] != NO_SLOT || nameSizes[slot] == 0 ||
+        nameOffsets[slot] > header->chars ||
+        nameSizes[slot] > header->chars - nameOffsets[slot]) {
+      return false;
+    }
+    byId[entries[slot]] = slot;
+  }
+  // Take over the arrays, the names stay in the mapped file.
+  _root->name = std::string_view(chars, header->root);
+  _dirs.assign(dirs, dirs + slots);
+  _entries.assign(entries, entries + slots);
+  _targets.assign(slots, NONE_ID);
+  _targets[0] = ROOT_ID;
+  _levels.assign(levels, levels + slots);
+  _pivots.assign(slots, MAX_LEVEL);
+  _moves.assign(slots, nullptr);
+  _moveCounts.assign(slots, 0);
+  _byId = std::move(byId);
+  _lookup.assign(lookupSize(slots), NO_SLOT);
+  for (Slot slot = 1; slot < slots; ++slot) {
+    std::string_view name(chars + nameOffsets[slot], nameSizes[slot]);
+    _nodeArena.create(node(dirs[slot]), name, entries[slot], slot);
+    // Each name may occur once within its directory.
+    if (findEntry(dirs[slot], name) != NO_SLOT) {
+      clear();
+      return false;
+    }
+    insertLookup(_lookup, slot, dirs[slot], name);
+  }
+  _snapshot = std::move(mapped);
+  _original = false;
+  return true;
+}
+
+void FileTree::endTarget(std::size_t threads, std::size_t chunk) {
+  // Include the added target nodes in the lookup table, they follow the
+  // original nodes in slot order.
+  buildLookup(static_cast<Slot>(_byId.size()));
+  if (threads == 1) {
+    computePivots(nullptr, chunk);
+    computeMoves(nullptr, chunk);
+  } else {
+    WorkPool pool(threads);
+    computePivots(&pool, chunk);
+    computeMoves(&pool, chunk);
+  }
+}
+
+const FileTree::PlanStats &FileTree::planStats() const { return _stats; }
+
+fs::path FileTree::basePath() const { return toPath(_root->name); }
 
 const FileTree::Node *FileTree::setBasePath(const fs::path &path) {
-  _root->name = path;
+  _root->name = _names.intern(path.native());
   return _root;
 }
 
@@ -199,196 +543,481 @@ FileTree::Id FileTree::nodeId(const FileTree::Node *node) {
 
 fs::path FileTree::nodeName(const FileTree::Node *node) {
   if (node) {
-    return node->name;
+    return toPath(node->name);
   }
   return fs::path();
 }
 
+std::string_view FileTree::nodeNameView(const FileTree::Node *node) {
+  if (node) {
+    return node->name;
+  }
+  return std::string_view();
+}
+
 FileTree::Id FileTree::maxEntryId() const { return _byId.size() - 1; }
 
 FileTree::Range FileTree::entries(const FileTree::Node *dir) const {
-  // Binary search the range of all entries in given directory.
-  const std::vector<Node *> *idx = index();
-  const Node value(dir);
-  auto range = std::equal_range(idx->begin(), idx->end(), &value, lessDir);
-  return {range.first, range.second};
+  const ChildIndex *idx = children();
+  auto nodes = idx->nodes.begin();
+  return {nodes + idx->begin[dir->slot], nodes + idx->begin[dir->slot + 1]};
 }
 
 void FileTree::generate(FileOpSequence &sequence) const {
   // Set maximum entry id for hex id length.
   sequence.setMaxEntryId(maxEntryId());
-  // Count additional target copies and add corresponding file operations.
+  // Count additional target copies.
   std::vector<int> copies(_byId.size(), 0);
-  for (const Node *node : _nodes) {
-    for (Level p = node->level; p >= 1; --p) {
-      const Node::Move &move = node->move(p);
-      if (isValidId(move.to) && move.to != move.from) {
-        sequence.addInOp(move.to, node->path(), false, node->level, p);
-        copies[move.to] += 1;
-      } else if (move.to == CREATE_DIR && move.to != move.from) {
-        sequence.addInOp(0, node->path(), true, node->level, p);
+  for (Slot slot = 1; slot < _levels.size(); ++slot) {
+    const Move *end = _moves[slot] + _moveCounts[slot];
+    for (const Move *mv = _moves[slot]; mv != end; ++mv) {
+      if (isValidId(mv->to)) {
+        copies[mv->to] += 1;
       }
     }
   }
-  // Add file operations out to temporary space.
-  for (const Node *node : _nodes) {
-    for (Level p = node->level; p >= 1; --p) {
-      const Node::Move &move = node->move(p);
-      if (p == node->level && isValidId(move.from) &&
-          (move.from != move.to || copies.at(move.from) > 0)) {
-        bool keep = (move.from == move.to);
-        sequence.addOutOp(move.from, node->path(), keep, node->level, p,
-                          copies.at(move.from));
-      } else if (move.from != NONE_ID && move.from != move.to) {
-        Id id = isValidId(move.from) ? move.from : ROOT_ID;
-        sequence.addOutOp(id, node->path(), false, node->level, p, 0);
+  // Add file operations in, and collect file operations out to temporary
+  // space to add them afterwards. Each path is built once per node.
+  struct OutOp {
+    Id id;
+    fs::path path;
+    bool keep;
+    Level level;
+    Level pivot;
+    int copies;
+  };
+  std::vector<OutOp> outOps;
+  std::string buffer;
+  for (Slot slot = 1; slot < _levels.size(); ++slot) {
+    Level level = _levels[slot];
+    fs::path path;
+    const Move *mv = _moves[slot];
+    const Move *end = mv + _moveCounts[slot];
+    // Only changed moves are stored. An entry kept at its own level is still
+    // copied out if it is copied elsewhere.
+    EntryId entry = _entries[slot];
+    if ((mv == end || mv->pivot != level) && isValidId(entry) &&
+        copies.at(entry) > 0) {
+      buildPath(slot, buffer);
+      path = buffer;
+      outOps.push_back({entry, path, true, level, level, copies.at(entry)});
+    }
+    for (; mv != end; ++mv) {
+      if (path.empty()) {
+        buildPath(slot, buffer);
+        path = buffer;
+      }
+      Level p = mv->pivot;
+      if (isValidId(mv->to)) {
+        sequence.addInOp(mv->to, path, false, level, p);
+      } else if (mv->to == CREATE_DIR) {
+        sequence.addInOp(0, path, true, level, p);
+      }
+      if (p == level && isValidId(mv->from)) {
+        outOps.push_back(
+            {mv->from, path, false, level, p, copies.at(mv->from)});
+      } else if (mv->from != NONE_ID) {
+        Id id = isValidId(mv->from) ? mv->from : ROOT_ID;
+        outOps.push_back({id, path, false, level, p, 0});
       }
     }
   }
+  for (OutOp &op : outOps) {
+    sequence.addOutOp(op.id, std::move(op.path), op.keep, op.level, op.pivot,
+                      op.copies);
+  }
 }
 
 void FileTree::clear() noexcept {
-  *_root = Node(_root, ROOT_ID, ROOT_ID, fs::path(), 0);
-
-  _byId.resize(1, _root);
-  for (const Node *node : _nodes) {
-    delete node;
-  }
-  _nodes.clear();
-  _index->clear();
+  *_root = Node(_root, std::string_view(), ROOT_ID, 0);
+
+  // Keep the root directory in slot 0 of the node arrays.
+  _dirs.assign(1, 0);
+  _entries.assign(1, ROOT_ID);
+  _targets.assign(1, ROOT_ID);
+  _levels.assign(1, 0);
+  _pivots.assign(1, MAX_LEVEL);
+  _moves.assign(1, nullptr);
+  _moveCounts.assign(1, 0);
+  _stats = {0, 0, 0};
+
+  _byId.assign(1, 0);
+  _lookup.clear();
+  _nodeArena.clear();
+  _moveArena.clear();
+  _names.clear();
+  _children->begin.clear();
+  _children->nodes.clear();
+  _snapshot.reset();
 }
 
 bool FileTree::operator==(const FileTree &other) const {
   return _root->name == other._root->name &&
-         std::equal(index()->begin(), index()->end(), other.index()->begin(),
-                    other.index()->end(),
-                    [](const Node *nodeA, const Node *nodeB) {
-                      return *nodeA == *nodeB;
-                    });
+         _levels.size() == other._levels.size() && equalEntries(other);
 }
 
 const FileTree::Node *FileTree::addEntry(const Node *dir,
                                          const fs::path &name) {
+  return addName(dir, name.native());
+}
+
+FileTree::Node *FileTree::addEntry(const Node *dir, Id entryId,
+                                   const fs::path &name) {
+  return addName(dir, entryId, name.native());
+}
+
+const FileTree::Node *FileTree::addName(const Node *dir,
+                                        std::string_view name) {
   if (_original) {
-    return addEntry(dir, _byId.size(), name);
+    return addName(dir, _byId.size(), name);
   } else {
-    return addEntry(dir, NONE_ID, name);
+    return addName(dir, NONE_ID, name);
   }
 }
 
-FileTree::Node *FileTree::addEntry(const Node *dir, Id entryId,
-                                   const fs::path &name) {
-  Node *node = nullptr;
+FileTree::Node *FileTree::addName(const Node *dir, Id entryId,
+                                  std::string_view name) {
+  Node *result = nullptr;
   if (dir) {
     if (_original) {
       if (isValidId(entryId)) {
         if (_byId.size() <= entryId) {
-          _byId.resize(entryId + 1, nullptr);
-        } else if (_byId.at(entryId)) {
-          throw std::runtime_error("Entry id of [" + name.string() +
+          _byId.resize(entryId + 1, NO_SLOT);
+        } else if (_byId.at(entryId) != NO_SLOT) {
+          throw std::runtime_error("Entry id of [" + std::string(name) +
                                    "] already in use.");
         }
-        node = new Node(dir, entryId, NONE_ID, name, dir->level + 1);
-        _byId[entryId] = node;
-        _nodes.push_back(node);
+        result = appendNode(dir, static_cast<EntryId>(entryId), NONE_ID,
+                            _names.intern(name));
+        _byId[entryId] = result->slot;
       } else {
-        throw std::runtime_error("Invalid entry id [" + name.string() + "].");
+        throw std::runtime_error("Invalid entry id [" + std::string(name) +
+                                 "].");
       }
-    } else {
+    } else if (isValidId(entryId) || entryId == NONE_ID) {
       // Search for a directory entry of the same name.
-      const Node value(dir, name);
-      auto range =
-          std::equal_range(_index->begin(), _index->end(), &value, lessDirName);
-      if (range.first != range.second) {
+      Slot found = findEntry(dir->slot, name);
+      if (found != NO_SLOT) {
         // Existing entry found, set target entry id accordingly.
-        node = _byId.at((*range.first)->entry);
-        node->target = entryId;
+        result = node(found);
+        _targets[found] = static_cast<EntryId>(entryId);
       } else {
         // No existing entry, create a new entry node and append it.
-        node = new Node(dir, NONE_ID, entryId, name, dir->level + 1);
-        _nodes.push_back(node);
+        result = appendNode(dir, NONE_ID, static_cast<EntryId>(entryId),
+                            _names.intern(name));
       }
+    } else {
+      throw std::runtime_error("Invalid entry id [" + std::string(name) +
+                               "].");
+    }
+  }
+  return result;
+}
+
+void FileTree::keepEntry(const Node *node) {
+  if (node && node->slot != 0 && isValidId(_entries[node->slot])) {
+    EntryId &target = _targets[node->slot];
+    if (isValidId(target) && target != _entries[node->slot]) {
+      throw std::runtime_error("Path of [" + nodePath(node).string() +
+                               "] is in use by another entry.");
+    }
+    target = _entries[node->slot];
+  }
+}
+
+FileTree::Node *FileTree::node(Slot slot) {
+  return slot == 0 ? _root : &_nodeArena[slot - 1];
+}
+
+const FileTree::Node *FileTree::node(Slot slot) const {
+  return slot == 0 ? _root : &_nodeArena[slot - 1];
+}
+
+void FileTree::buildPath(Slot slot, std::string &buffer) const {
+  // Measure the path, the root part is followed by a separator unless it is
+  // empty or already ends with one.
+  std::string_view root = _root->name;
+  bool separator = !root.empty() && root.back() != '/';
+  std::size_t size = root.size() + (separator ? 1 : 0);
+  for (Slot s = slot; s != 0; s = _dirs[s]) {
+    size += node(s)->name.size() + 1;
+  }
+  // Fill in the entry names from the end, keeping the buffer capacity.
+  buffer.resize(size - 1);
+  std::size_t end = buffer.size();
+  for (Slot s = slot; s != 0; s = _dirs[s]) {
+    std::string_view name = node(s)->name;
+    end -= name.size();
+    buffer.replace(end, name.size(), name.data(), name.size());
+    if (end > 0) {
+      buffer[--end] = '/';
     }
   }
-  return node;
+  buffer.replace(0, root.size(), root.data(), root.size());
 }
 
-void FileTree::computePivots() {
-  for (Node *node : _nodes) {
+FileTree::Node *FileTree::appendNode(const Node *dir, EntryId entry,
+                                     EntryId target, std::string_view name) {
+  if (_levels.size() >= NO_SLOT) {
+    throw std::runtime_error("Too many entries in file tree.");
+  }
+  Level level = _levels[dir->slot] + 1;
+  if (level >= MAX_LEVEL) {
+    throw std::runtime_error("Directory level too deep at [" +
+                             std::string(name) + "].");
+  }
+  auto slot = static_cast<Slot>(_levels.size());
+  Node *result = _nodeArena.create(dir, name, entry, slot);
+  _dirs.push_back(dir->slot);
+  _entries.push_back(entry);
+  _targets.push_back(target);
+  _levels.push_back(static_cast<EntryLvl>(level));
+  _pivots.push_back(MAX_LEVEL);
+  _moves.push_back(nullptr);
+  _moveCounts.push_back(0);
+  return result;
+}
+
+void FileTree::buildLookup(Slot first) {
+  // Start over if the table has to grow, otherwise only add the new slots.
+  if (first <= 1 || _lookup.size() < 2 * _levels.size()) {
+    _lookup.assign(lookupSize(_levels.size()), NO_SLOT);
+    first = 1;
+  }
+  for (Slot slot = first; slot < _levels.size(); ++slot) {
+    insertLookup(_lookup, slot, _dirs[slot], node(slot)->name);
+  }
+}
+
+FileTree::Slot FileTree::findEntry(Slot dir, std::string_view name) const {
+  if (_lookup.empty()) {
+    return NO_SLOT;
+  }
+  // Linear probing until the entry or an empty bucket is found.
+  std::size_t mask = _lookup.size() - 1;
+  for (std::size_t i = lookupHash(dir, name) & mask; _lookup[i] != NO_SLOT;
+       i = (i + 1) & mask) {
+    Slot slot = _lookup[i];
+    if (_dirs[slot] == dir && node(slot)->name == name) {
+      return slot;
+    }
+  }
+  return NO_SLOT;
+}
+
+void FileTree::computePivots(WorkPool *pool, std::size_t chunk) {
+  const LevelAncestors ancestors(_dirs, _levels);
+  forEachSlot(_levels, pool, chunk, [this, &ancestors](Slot slot) {
     // Compute pivot level if the path has changed.
-    if (isValidId(node->target) && node->entry != node->target) {
-      node->pivot = pivot(node, _byId.at(node->target));
-      if (node->pivot < node->level && node->dir->pivot < node->pivot) {
+    EntryId target = _targets[slot];
+    if (isValidId(target) && _entries[slot] != target) {
+      Level pvt = ancestors.pivot(slot, _byId.at(target));
+      Level parentPvt = _pivots[_dirs[slot]];
+      if (pvt < _levels[slot] && parentPvt < pvt) {
         // Inherit smaller pivot from parent directory.
-        node->pivot = node->dir->pivot;
+        pvt = parentPvt;
       }
-    } else if (!isValidId(node->target)) {
-      node->pivot = node->level;
+      _pivots[slot] = static_cast<EntryLvl>(pvt);
+    } else if (!isValidId(target)) {
+      _pivots[slot] = _levels[slot];
     }
+  });
+}
+
+FileTree::EntryId FileTree::levelTarget(Slot slot, bool requested) const {
+  // Same as the first move computed by computeMoves(), at the slot level.
+  EntryId next = _entries[slot];
+  if (_levels[slot] == _pivots[slot]) {
+    next = _targets[slot];
+  } else if (_entries[slot] != _targets[slot]) {
+    next = NONE_ID;
   }
+  if (!isValidId(next) && requested) {
+    next = CREATE_DIR;
+  }
+  return next;
 }
 
-void FileTree::computeMoves() {
-  for (Node *node : _nodes) {
-    // Initialize level number of moves with NONE_ID ids.
-    node->moves.resize(node->level, {NONE_ID, NONE_ID});
+void FileTree::computeMoves(WorkPool *pool, std::size_t chunk) {
+  // A slot keeps its entry at all pivots if no entry changes in its subtree
+  // nor in a directory on its path. Mark the slots where that is not the case.
+  enum : char { PATH_CHANGED = 1, SUBTREE_CHANGED = 2, REQUESTED = 4 };
+  std::vector<char> changes(_levels.size(), 0);
+  for (Slot slot = static_cast<Slot>(_levels.size()) - 1; slot > 0; --slot) {
+    if (_entries[slot] != _targets[slot] || !isValidId(_targets[slot])) {
+      changes[slot] |= PATH_CHANGED | SUBTREE_CHANGED;
+    }
+    if (changes[slot] & SUBTREE_CHANGED) {
+      changes[_dirs[slot]] |= SUBTREE_CHANGED;
+    }
+  }
+  for (Slot slot = 1; slot < _levels.size(); ++slot) {
+    if (changes[_dirs[slot]] & PATH_CHANGED) {
+      changes[slot] |= PATH_CHANGED;
+    }
+    _moves[slot] = nullptr;
+    _moveCounts[slot] = 0;
   }
-  for (const Node *node : _nodes) {
-    // Request intermediate target directories if missing, to pivot depth.
-    for (const Node *parent = node->dir;
-         parent && parent->level >= node->pivot && parent->dir != parent;
-         parent = parent->dir) {
-      auto it = std::find(_nodes.begin(), _nodes.end(), parent);
-      if (it != _nodes.end()) {
-        (*it)->move(node->pivot).to = CREATE_DIR;
+  // Request intermediate target directories if missing, to pivot depth.
+  // Stop at a directory already requested, its parents are requested too.
+  std::vector<std::uint64_t> requests;
+  std::size_t walked = 0;
+  {
+    std::unordered_set<std::uint64_t> requested;
+    for (Slot slot = 1; slot < _levels.size(); ++slot) {
+      Level pvt = _pivots[slot];
+      Slot parent = _dirs[slot];
+      while (parent != 0 && _levels[parent] >= pvt &&
+             requested.insert(requestKey(parent, pvt)).second) {
+        changes[parent] |= REQUESTED;
+        parent = _dirs[parent];
+        ++walked;
       }
     }
+    requests.assign(requested.begin(), requested.end());
+    std::sort(requests.begin(), requests.end());
   }
-  for (Node *node : _nodes) {
-    // Iterate relevant pivots from level to 1.
-    Id previous = node->entry;
-    for (Level p = node->level; p >= 1; --p) {
+  std::atomic<std::size_t> visits(walked);
+  std::atomic<std::size_t> stored(0);
+  std::mutex arenaMutex;
+  auto plan = [this, pool, &changes, &requests, &visits, &stored,
+               &arenaMutex](Slot slot) {
+    if (!changes[slot]) {
+      return;
+    }
+    // Reused buffer for the changed moves of a slot, per planning thread.
+    thread_local std::vector<Move> changed;
+    changed.clear();
+    // Iterate relevant pivots from level to 1, along with the parent moves
+    // and the requests of this slot, which are sorted the same way.
+    Slot dir = _dirs[slot];
+    Level level = _levels[slot];
+    const Move *dirMove = _moves[dir];
+    const Move *dirEnd = dirMove + _moveCounts[dir];
+    auto request = requests.end();
+    if (changes[slot] & REQUESTED) {
+      request = std::lower_bound(requests.begin(), requests.end(),
+                                 requestKey(slot, level));
+    }
+    EntryId previous = _entries[slot];
+    for (Level p = level; p >= 1; --p) {
       // Consider prior parent directory changes in this pivot.
-      if (p <= node->dir->level &&
-          node->dir->move(p).from != node->dir->move(p).to) {
+      while (dirMove != dirEnd && dirMove->pivot > p) {
+        ++dirMove;
+      }
+      if (dirMove != dirEnd && dirMove->pivot == p) {
         // Most parent directory changes result in a non-existing entry.
         previous = NONE_ID;
-        if (isValidId(node->dir->move(p).to)) {
+        if (isValidId(dirMove->to)) {
           // Search for a former entry in the original directory with this name.
-          const Node value(_byId.at(node->dir->move(p).to), node->name);
-          auto range = std::equal_range(index()->begin(), index()->end(),
-                                        &value, lessDirName);
-          if (range.first != range.second) {
+          Slot former = findEntry(_byId.at(dirMove->to), node(slot)->name);
+          if (former != NO_SLOT) {
             // Adopt former entry that is copied with its parent directory.
-            const Node *former = *range.first;
-            previous = former->move(former->level).to;
+            // Planned in slot order, a later former entry is still unmoved.
+            bool formerRequest =
+                (changes[former] & REQUESTED) &&
+                std::binary_search(requests.begin(), requests.end(),
+                                   requestKey(former, _levels[former]));
+            if (former <= slot) {
+              previous = levelTarget(former, formerRequest);
+            } else {
+              previous = formerRequest ? CREATE_DIR : NONE_ID;
+            }
           }
         }
       }
       // Keep previous entry id except for ...
-      Id next = previous;
-      if (p == node->pivot) {
+      EntryId next = previous;
+      if (p == _pivots[slot]) {
         // ... target id when we reach its pivot and ...
-        next = node->target;
-      } else if (p == node->level && node->entry != node->target) {
+        next = _targets[slot];
+      } else if (p == level && _entries[slot] != _targets[slot]) {
         // ... when we move out the original entry at the beginning.
         next = NONE_ID;
       }
-      if (!isValidId(next) && node->move(p).to == CREATE_DIR) {
+      bool requested =
+          request != requests.end() && *request == requestKey(slot, p);
+      if (requested) {
+        ++request;
+      }
+      if (!isValidId(next) && requested) {
         // Create intermediate directory if necessary, none is set explicitly.
         next = CREATE_DIR;
       }
-      // Set move at pivot p from previous to next entry id.
-      node->move(p) = {previous, next};
+      // Keep the move at pivot p from previous to next entry id if changed.
+      if (previous != next) {
+        changed.push_back({static_cast<EntryLvl>(p), previous, next});
+      }
       previous = next;
     }
+    visits.fetch_add(level, std::memory_order_relaxed);
+    stored.fetch_add(changed.size(), std::memory_order_relaxed);
+    if (!changed.empty()) {
+      // Parallel planning tasks share the arena.
+      std::unique_lock<std::mutex> lock(arenaMutex, std::defer_lock);
+      if (pool) {
+        lock.lock();
+      }
+      Move *moves = _moveArena.createArray(changed.size(), changed.front());
+      std::copy(changed.begin(), changed.end(), moves);
+      _moves[slot] = moves;
+      _moveCounts[slot] = static_cast<EntryLvl>(changed.size());
+    }
+  };
+  forEachSlot(_levels, pool, chunk, plan);
+  _stats = {requests.size(), visits, stored};
+}
+
+bool FileTree::equalEntries(const FileTree &other) const {
+  // Compare the directories pairwise on a stack instead of recursion.
+  std::vector<std::pair<Range, Range>> stack = {
+      {entries(_root), other.entries(other._root)}};
+  while (!stack.empty()) {
+    Range &range = stack.back().first;
+    Range &otherRange = stack.back().second;
+    if (range.begin == range.end || otherRange.begin == otherRange.end) {
+      if (range.begin != range.end || otherRange.begin != otherRange.end) {
+        return false;
+      }
+      stack.pop_back();
+      continue;
+    }
+    const Node *nodeA = *(range.begin++);
+    const Node *nodeB = *(otherRange.begin++);
+    if (nodeA->entry != nodeB->entry ||
+        _targets[nodeA->slot] != other._targets[nodeB->slot] ||
+        nodeA->name != nodeB->name) {
+      return false;
+    }
+    stack.emplace_back(entries(nodeA), other.entries(nodeB));
   }
+  return true;
 }
 
-const std::vector<FileTree::Node *> *FileTree::index() const {
-  if (_index->size() != _nodes.size()) {
-    *_index = _nodes;
-    std::sort(_index->begin(), _index->end(), lessDirName);
+const FileTree::ChildIndex *FileTree::children() const {
+  if (_children->begin.size() != _levels.size() + 1) {
+    // Count the entries of each directory at begin[dir + 2].
+    std::vector<Slot> &begin = _children->begin;
+    begin.assign(_levels.size() + 2, 0);
+    for (Slot slot = 1; slot < _levels.size(); ++slot) {
+      ++begin[_dirs[slot] + 2];
+    }
+    // Prefix sums turn begin[dir + 1] into the offset of the entries of dir.
+    for (std::size_t i = 2; i < begin.size(); ++i) {
+      begin[i] += begin[i - 1];
+    }
+    // Placing the entries moves begin[dir + 1] on to the offset of dir + 1.
+    std::vector<const Node *> &nodes = _children->nodes;
+    nodes.resize(_levels.size() - 1);
+    for (Slot slot = 1; slot < _levels.size(); ++slot) {
+      nodes[begin[_dirs[slot] + 1]++] = node(slot);
+    }
+    begin.pop_back();
+    // Sort the entries of each directory by name.
+    for (Slot slot = 0; slot + 1 < begin.size(); ++slot) {
+      std::sort(nodes.begin() + begin[slot], nodes.begin() + begin[slot + 1],
+                lessName);
+    }
   }
-  return _index;
+  return _children;
 }
@@ -9,9 +9,17 @@ namespace fs = std::filesystem;
 namespace fs = std::experimental::filesystem;
 #endif
 
+#include "ViFi/Arena.hpp"
+#include "ViFi/NamePool.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
 #include <vector>
 
 class FileOpSequence;
+class MappedFile;
+class WorkPool;
 
 /*!
  * \class FileTree FileTree.hpp "ViFi/FileTree.hpp"
@@ -34,14 +42,27 @@ class FileOpSequence;
  * 4. Finish the changed file tree with endTarget().
  * 5. Let generate() create the file operation sequence from the changes.
  *
- * For efficiency, FileTree keeps indexes of the path nodes sorted by id and
- * by parent directory / entry name.
+ * For efficiency, FileTree keeps an index of the path nodes sorted by id, a
+ * hash table to look up entries by parent directory and name, and the entries
+ * of each directory sorted by name in one contiguous array. Entry names are
+ * stored once per distinct name in a shared NamePool. Subtrees that are equal
+ * in the original and the changed file tree, below unchanged parent
+ * directories, are left out of planning.
+ *
+ * Node handles only carry the parent, name and id of an entry. The fields
+ * used while planning the moves are kept in parallel arrays indexed by node
+ * slot, with 32-bit entry ids and 16-bit directory levels. Of the moves per
+ * pivot level, only those that change the entry are stored. This limits a tree
+ * to about 4 billion entries and 65534 directory levels.
  */
 class FileTree {
 public:
   typedef std::size_t Id;    //!< Identifier for directory and file entries.
   typedef std::size_t Level; //!< Type used for directory levels.
 
+  //! Default minimum number of entries planned by one task, see endTarget().
+  static constexpr std::size_t PLAN_CHUNK = 4096;
+
   struct Node; //!< Stores a directory entry as a node in the file tree.
 
   /*!
@@ -59,10 +80,55 @@ public:
    */
   void endOriginal();
 
+  /*!
+   * \brief Write the original tree to a binary snapshot file.
+   *
+   * The snapshot holds the nodes in the order ReadText adds them from a text
+   * file written by WriteText, with their names, so that loadSnapshot()
+   * restores the same tree without parsing the text. Size and modification
+   * time of the text file are stored to detect later edits.
+   * \param file Path of the snapshot file, which is replaced.
+   * \param text Path of the text file written for the tree.
+   * \exception std::runtime_error If the original tree is not finished by
+   *            endOriginal() or a file cannot be read or written.
+   */
+  void saveSnapshot(const fs::path &file, const fs::path &text) const;
+
+  /*!
+   * \brief Load an original tree from a binary snapshot file.
+   *
+   * Replaces the content of the tree. The file is mapped into memory and the
+   * names are used in place, the tree is ready for the target as if
+   * endOriginal() was called.
+   * \param file Path of a snapshot file written by saveSnapshot().
+   * \param text Path of the text file the snapshot was written for.
+   * \return False if the file is missing or invalid, or the text file changed
+   *         since, the tree is empty then.
+   */
+  bool loadSnapshot(const fs::path &file, const fs::path &text);
+
   /*!
    * \brief Ends loading the target tree, prepares for generate().
+   *
+   * Planning runs level by level on a work pool if more than one thread is
+   * given, with the same result as planning on a single thread. Levels with
+   * up to chunk entries are planned on the calling thread.
+   * \param threads Number of planning threads, 0 uses one per hardware thread.
+   * \param chunk Minimum number of entries planned by one task of the pool.
    */
-  void endTarget();
+  void endTarget(std::size_t threads = 1, std::size_t chunk = PLAN_CHUNK);
+
+  //! Amount of work done by planning, independent of the thread count.
+  struct PlanStats {
+    std::size_t requests; //!< Intermediate directories requested per pivot.
+    std::size_t visits;   //!< Directory and pivot levels visited.
+    std::size_t moves;    //!< Moves stored because they change the entry.
+  };
+
+  /*!
+   * \brief Get the amount of work done by the last endTarget().
+   */
+  const PlanStats &planStats() const;
 
   /*!
    * \brief Get the base directory.
@@ -103,6 +169,13 @@ public:
    */
   static fs::path nodeName(const Node *node);
 
+  /*!
+   * \brief Get the entry name of a file tree node without copying it.
+   * \param node File tree node.
+   * \return View of the name stored in the tree, empty if node is invalid.
+   */
+  static std::string_view nodeNameView(const Node *node);
+
   /*!
    * \brief Get the maximum entry id.
    * \return Maximum id used by any entry in the file tree.
@@ -111,8 +184,8 @@ public:
 
   //! Range of nodes in a vector.
   struct Range {
-    std::vector<Node *>::const_iterator begin; //!< Begin of the range.
-    std::vector<Node *>::const_iterator end;   //!< End of the range.
+    std::vector<const Node *>::const_iterator begin; //!< Begin of the range.
+    std::vector<const Node *>::const_iterator end;   //!< End of the range.
   };
 
   /*!
@@ -152,20 +225,86 @@ public:
    */
   Node *addEntry(const Node *dir, Id entryId, const fs::path &name);
 
+  /*!
+   * \brief Add an entry node to given directory, see addEntry().
+   * \param dir Parent directory handler.
+   * \param name Name of the entry, copied into the tree.
+   * \return Handler for the added entry, null on failure.
+   */
+  const Node *addName(const Node *dir, std::string_view name);
+
+  /*!
+   * \brief Add an entry node to given directory, see addEntry().
+   * \param dir Parent directory handler.
+   * \param entryId Id of the entry to be added.
+   * \param name Name of the entry, copied into the tree.
+   * \return Handler for the added entry, null on failure.
+   */
+  Node *addName(const Node *dir, Id entryId, std::string_view name);
+
+  /*!
+   * \brief Keep an original entry at its path in the target tree.
+   *
+   * Nodes without an original entry are ignored.
+   * \param node Node of the entry, added to the original tree.
+   * \exception std::runtime_error If a different entry is added to the path
+   *            of the node in the target tree.
+   */
+  void keepEntry(const Node *node);
+
 private:
-  // Compute pivot levels.
-  void computePivots();
-  // Compute moves per pivot.
-  void computeMoves();
-  // Get and update node index sorted by directory and name.
-  const std::vector<Node *> *index() const;
-
-  Node *_root;    // Root directory of the file tree.
+  typedef std::uint32_t Slot;     // Position of a node in the node arrays.
+  typedef std::uint32_t EntryId;  // Entry id as stored in the node arrays.
+  typedef std::uint16_t EntryLvl; // Directory level as stored in node arrays.
+
+  struct Move;       // Entry change of a node at one pivot.
+  struct ChildIndex; // Entries of all directories, sorted by name.
+
+  // Get the node handle of a slot.
+  Node *node(Slot slot);
+  const Node *node(Slot slot) const;
+  // Write the path of a slot to a reusable buffer.
+  void buildPath(Slot slot, std::string &buffer) const;
+  // Append a node to the node arrays.
+  Node *appendNode(const Node *dir, EntryId entry, EntryId target,
+                   std::string_view name);
+  // Add the nodes from slot first on to the lookup table, all if it grows.
+  void buildLookup(Slot first);
+  // Find the slot of a directory entry by name, NO_SLOT if missing.
+  Slot findEntry(Slot dir, std::string_view name) const;
+  // Compute pivot levels, on the work pool if not null.
+  void computePivots(WorkPool *pool, std::size_t chunk);
+  // Entry id after the first move of a slot, given its directory request.
+  EntryId levelTarget(Slot slot, bool requested) const;
+  // Compute moves per pivot, on the work pool if not null.
+  void computeMoves(WorkPool *pool, std::size_t chunk);
+  // Compare the entries of all directories with another tree.
+  bool equalEntries(const FileTree &other) const;
+  // Get and update the entries of all directories.
+  const ChildIndex *children() const;
+
+  Node *_root;    // Root directory of the file tree, slot 0.
   bool _original; // Set when loading an original file tree.
 
-  std::vector<Node *> _byId;   // Access to original nodes by entry id.
-  std::vector<Node *> _nodes;  // All nodes except root.
-  std::vector<Node *> *_index; // Nodes sorted by directory and name.
+  Arena<Node> _nodeArena; // Handles of all nodes except root, slot order.
+  Arena<Move> _moveArena; // Storage of the moves of all nodes.
+  NamePool _names;        // Storage of all entry names.
+
+  // Node arrays, indexed by slot.
+  std::vector<Slot> _dirs;           // Slot of the parent directory.
+  std::vector<EntryId> _entries;     // Original entry id.
+  std::vector<EntryId> _targets;     // Target entry id.
+  std::vector<EntryLvl> _levels;     // Directory depth level.
+  std::vector<EntryLvl> _pivots;     // Level of first path difference.
+  std::vector<Move *> _moves;        // Changed moves, descending pivot.
+  std::vector<EntryLvl> _moveCounts; // Number of changed moves.
+
+  std::vector<Slot> _byId;   // Slots of original nodes by entry id.
+  std::vector<Slot> _lookup; // Hash table of slots by parent and name.
+  ChildIndex *_children;     // Entries per directory, sorted by name.
+
+  std::unique_ptr<MappedFile> _snapshot; // Mapped snapshot, original names.
+  PlanStats _stats;                      // Work done by the last planning.
 };
 
 #endif // FILETREE_HPP
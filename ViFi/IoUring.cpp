@@ -0,0 +1,153 @@
+#include "ViFi/IoUring.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+
+// Throw a system error for the last failed system call.
+[[noreturn]] void throwErrno(const char *what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Get a pointer at given byte offset into a memory mapping.
+template <typename T> T *at(void *map, std::uint32_t offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(map) + offset);
+}
+
+} // namespace
+
+IoUring::IoUring(unsigned entries)
+    : _fd(-1), _entries(0), _prepared(0), _enters(0), _sqMap(MAP_FAILED),
+      _sqMapSize(0), _cqMap(MAP_FAILED), _cqMapSize(0),
+      _sqes(static_cast<io_uring_sqe *>(MAP_FAILED)), _sqesSize(0) {
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CLAMP;
+  _fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+  if (_fd < 0) {
+    throwErrno("io_uring is not available");
+  }
+  _entries = params.sq_entries;
+
+  // Map the queue rings, which may share a single mapping.
+  _sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  _cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single) {
+    _sqMapSize = std::max(_sqMapSize, _cqMapSize);
+  }
+  _sqMap = ::mmap(nullptr, _sqMapSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+  if (_sqMap == MAP_FAILED) {
+    int error = errno;
+    release();
+    errno = error;
+    throwErrno("Failed to map io_uring submission queue");
+  }
+  if (single) {
+    _cqMap = _sqMap;
+  } else {
+    _cqMap = ::mmap(nullptr, _cqMapSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+  }
+  _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  _sqes = static_cast<io_uring_sqe *>(
+      ::mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+  if (_cqMap == MAP_FAILED || _sqes == MAP_FAILED) {
+    int error = errno;
+    release();
+    errno = error;
+    throwErrno("Failed to map io_uring queues");
+  }
+
+  _sqHead = at<unsigned>(_sqMap, params.sq_off.head);
+  _sqTail = at<unsigned>(_sqMap, params.sq_off.tail);
+  _sqMask = at<unsigned>(_sqMap, params.sq_off.ring_mask);
+  _sqArray = at<unsigned>(_sqMap, params.sq_off.array);
+  _cqHead = at<unsigned>(_cqMap, params.cq_off.head);
+  _cqTail = at<unsigned>(_cqMap, params.cq_off.tail);
+  _cqMask = at<unsigned>(_cqMap, params.cq_off.ring_mask);
+  _cqes = at<io_uring_cqe>(_cqMap, params.cq_off.cqes);
+}
+
+IoUring::~IoUring() { release(); }
+
+unsigned IoUring::entries() const { return _entries; }
+
+std::size_t IoUring::enterCalls() const { return _enters; }
+
+void IoUring::release() {
+  if (_sqes != MAP_FAILED) {
+    ::munmap(_sqes, _sqesSize);
+  }
+  if (_cqMap != MAP_FAILED && _cqMap != _sqMap) {
+    ::munmap(_cqMap, _cqMapSize);
+  }
+  if (_sqMap != MAP_FAILED) {
+    ::munmap(_sqMap, _sqMapSize);
+  }
+  if (_fd >= 0) {
+    ::close(_fd);
+  }
+  _sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+  _cqMap = MAP_FAILED;
+  _sqMap = MAP_FAILED;
+  _fd = -1;
+}
+
+io_uring_sqe *IoUring::next() {
+  unsigned head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+  unsigned tail = *_sqTail;
+  if (tail - head >= _entries) {
+    return nullptr;
+  }
+  unsigned index = tail & *_sqMask;
+  io_uring_sqe *sqe = &_sqes[index];
+  std::memset(sqe, 0, sizeof(io_uring_sqe));
+  _sqArray[index] = index;
+  // Publish the entry, it is only consumed on the next io_uring_enter.
+  __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+  ++_prepared;
+  return sqe;
+}
+
+void IoUring::submitAndWait(unsigned count) {
+  while (_prepared > 0 || count > 0) {
+    unsigned flags = count > 0 ? IORING_ENTER_GETEVENTS : 0;
+    long submitted = ::syscall(__NR_io_uring_enter, _fd, _prepared, count,
+                               flags, nullptr, 0);
+    ++_enters;
+    if (submitted < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throwErrno("Failed to submit io_uring requests");
+    }
+    _prepared -= static_cast<unsigned>(submitted);
+    // Waiting is done once the completions are available.
+    unsigned head = *_cqHead;
+    unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+    if (tail - head >= count) {
+      count = 0;
+    }
+  }
+}
+
+bool IoUring::pop(std::uint64_t &userData, int &result) {
+  unsigned head = *_cqHead;
+  unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+  if (head == tail) {
+    return false;
+  }
+  const io_uring_cqe &cqe = _cqes[head & *_cqMask];
+  userData = cqe.user_data;
+  result = cqe.res;
+  __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
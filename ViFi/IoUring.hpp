@@ -0,0 +1,91 @@
+#ifndef IOURING_HPP
+#define IOURING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+/*!
+ * \class IoUring IoUring.hpp "ViFi/IoUring.hpp"
+ * \brief Minimal Linux io_uring submission and completion queue pair.
+ *
+ * Wraps the io_uring system calls directly, without liburing. Requests are
+ * prepared in submission queue entries taken from next(), then submitted in
+ * one system call together with waiting for their completions.
+ *
+ * Typical usage goes as follows:
+ * 1. Prepare up to entries() requests through next().
+ * 2. Submit them and wait for completions with submitAndWait().
+ * 3. Collect the completion results with pop().
+ */
+class IoUring {
+public:
+  /*!
+   * \brief Set up the queues.
+   * \param entries Requested queue depth, clamped to the kernel limit.
+   * \exception std::system_error If io_uring is not available.
+   */
+  explicit IoUring(unsigned entries);
+  ~IoUring(); //!< Unmap the queues and close the ring.
+
+  IoUring(const IoUring &) = delete;            //!< Not copyable.
+  IoUring &operator=(const IoUring &) = delete; //!< Not copyable.
+
+  /*!
+   * \brief Get the submission queue depth.
+   */
+  unsigned entries() const;
+
+  /*!
+   * \brief Get the number of io_uring_enter system calls made so far.
+   */
+  std::size_t enterCalls() const;
+
+  /*!
+   * \brief Get a cleared submission queue entry to be prepared.
+   * \return Next submission queue entry, null if the queue is full.
+   */
+  io_uring_sqe *next();
+
+  /*!
+   * \brief Submit prepared entries and wait for completions.
+   * \param count Number of completions to wait for.
+   * \exception std::system_error If the submission fails.
+   */
+  void submitAndWait(unsigned count);
+
+  /*!
+   * \brief Take the next completion from the completion queue.
+   * \param userData Set to the user data of the completed request.
+   * \param result Set to the result of the completed request.
+   * \return True if a completion was available.
+   */
+  bool pop(std::uint64_t &userData, int &result);
+
+private:
+  // Unmap the queues and close the ring, if set up.
+  void release();
+
+  int _fd;             // Ring file descriptor.
+  unsigned _entries;   // Submission queue depth.
+  unsigned _prepared;  // Entries prepared but not yet submitted.
+  std::size_t _enters; // Number of io_uring_enter system calls.
+
+  void *_sqMap;           // Mapped submission queue ring.
+  std::size_t _sqMapSize; // Size of the submission queue mapping.
+  void *_cqMap;           // Mapped completion queue ring, may share _sqMap.
+  std::size_t _cqMapSize; // Size of the completion queue mapping.
+  io_uring_sqe *_sqes;    // Mapped submission queue entries.
+  std::size_t _sqesSize;  // Size of the submission queue entry mapping.
+
+  unsigned *_sqHead;   // Submission queue head, advanced by the kernel.
+  unsigned *_sqTail;   // Submission queue tail, advanced by us.
+  unsigned *_sqMask;   // Submission queue index mask.
+  unsigned *_sqArray;  // Submission queue indirection array.
+  unsigned *_cqHead;   // Completion queue head, advanced by us.
+  unsigned *_cqTail;   // Completion queue tail, advanced by the kernel.
+  unsigned *_cqMask;   // Completion queue index mask.
+  io_uring_cqe *_cqes; // Completion queue entries.
+};
+
+#endif // IOURING_HPP
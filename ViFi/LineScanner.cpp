@@ -0,0 +1,219 @@
+#include "ViFi/LineScanner.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VIFI_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+constexpr std::size_t BLOCK = 64;   // Bytes per block of masks.
+constexpr std::size_t MAX_ID = 16;  // Hex digits that fit into 64 bits.
+
+// Check whether a character is a hex digit.
+bool isHex(unsigned char c) {
+  return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+// Classify blocks byte by byte.
+void classifyScalar(const char *text, std::size_t blocks,
+                    LineScanner::Masks *masks) {
+  for (std::size_t b = 0; b < blocks; ++b, text += BLOCK) {
+    LineScanner::Masks block = {0, 0, 0};
+    for (std::size_t i = 0; i < BLOCK; ++i) {
+      auto c = static_cast<unsigned char>(text[i]);
+      std::uint64_t bit = std::uint64_t(1) << i;
+      block.newlines |= (c == '\n') ? bit : 0;
+      block.tabs |= (c == '\t') ? bit : 0;
+      block.invalid |= isHex(c) ? 0 : bit;
+    }
+    masks[b] = block;
+  }
+}
+
+#ifdef VIFI_X86
+// Collect the top bits of 16 bytes.
+std::uint64_t maskSSE2(__m128i bytes) {
+  return static_cast<std::uint16_t>(_mm_movemask_epi8(bytes));
+}
+
+// Collect the top bits of 32 bytes.
+__attribute__((target("avx2"))) std::uint64_t maskAVX2(__m256i bytes) {
+  return static_cast<std::uint32_t>(_mm256_movemask_epi8(bytes));
+}
+
+// Classify 16 bytes into 16-bit masks.
+void classifySSE2(const char *bytes, std::uint64_t &newlines,
+                  std::uint64_t &tabs, std::uint64_t &hex, int shift) {
+  __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes));
+  // Hex digits are in 0-9 or, with the case bit set, in a-f.
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i digit = _mm_and_si128(
+      _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8('0')), v),
+      _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8('9')), v));
+  __m128i letter = _mm_and_si128(
+      _mm_cmpeq_epi8(_mm_max_epu8(lower, _mm_set1_epi8('a')), lower),
+      _mm_cmpeq_epi8(_mm_min_epu8(lower, _mm_set1_epi8('f')), lower));
+  newlines |= maskSSE2(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))) << shift;
+  tabs |= maskSSE2(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))) << shift;
+  hex |= maskSSE2(_mm_or_si128(digit, letter)) << shift;
+}
+
+// Classify blocks 16 bytes at a time.
+void classifySSE2(const char *text, std::size_t blocks,
+                  LineScanner::Masks *masks) {
+  for (std::size_t b = 0; b < blocks; ++b, text += BLOCK) {
+    std::uint64_t newlines = 0, tabs = 0, hex = 0;
+    for (int i = 0; i < 4; ++i) {
+      classifySSE2(text + 16 * i, newlines, tabs, hex, 16 * i);
+    }
+    masks[b] = {newlines, tabs, ~hex};
+  }
+}
+
+// Classify 32 bytes into 32-bit masks.
+__attribute__((target("avx2"))) void
+classifyAVX2(const char *bytes, std::uint64_t &newlines, std::uint64_t &tabs,
+             std::uint64_t &hex, int shift) {
+  __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes));
+  // Hex digits are in 0-9 or, with the case bit set, in a-f.
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i digit = _mm256_and_si256(
+      _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8('0')), v),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8('9')), v));
+  __m256i letter = _mm256_and_si256(
+      _mm256_cmpeq_epi8(_mm256_max_epu8(lower, _mm256_set1_epi8('a')), lower),
+      _mm256_cmpeq_epi8(_mm256_min_epu8(lower, _mm256_set1_epi8('f')), lower));
+  newlines |= maskAVX2(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))) << shift;
+  tabs |= maskAVX2(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))) << shift;
+  hex |= maskAVX2(_mm256_or_si256(digit, letter)) << shift;
+}
+
+// Classify blocks 32 bytes at a time.
+__attribute__((target("avx2"))) void
+classifyAVX2(const char *text, std::size_t blocks, LineScanner::Masks *masks) {
+  for (std::size_t b = 0; b < blocks; ++b, text += BLOCK) {
+    std::uint64_t newlines = 0, tabs = 0, hex = 0;
+    classifyAVX2(text, newlines, tabs, hex, 0);
+    classifyAVX2(text + 32, newlines, tabs, hex, 32);
+    masks[b] = {newlines, tabs, ~hex};
+  }
+}
+#endif
+
+// Index of the lowest set bit, the mask must not be zero.
+unsigned lowestBit(std::uint64_t mask) {
+  return static_cast<unsigned>(__builtin_ctzll(mask));
+}
+
+// Mask of the bits below the lowest set bit, all bits if none is set.
+std::uint64_t bitsBefore(std::uint64_t mask) { return (mask - 1) & ~mask; }
+} // namespace
+
+bool LineScanner::supported(Kernel kernel) {
+  switch (kernel) {
+  case Kernel::Scalar:
+    return true;
+#ifdef VIFI_X86
+  case Kernel::SSE2:
+    return __builtin_cpu_supports("sse2");
+  case Kernel::AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+LineScanner::Kernel LineScanner::fastest() {
+  static const Kernel kernel = supported(Kernel::AVX2)   ? Kernel::AVX2
+                               : supported(Kernel::SSE2) ? Kernel::SSE2
+                                                         : Kernel::Scalar;
+  return kernel;
+}
+
+LineScanner::LineScanner(std::string_view text, Kernel kernel)
+    : _text(text), _classify(classifyScalar), _pos(0), _window(0),
+      _block(0), _masks() {
+  if (!supported(kernel)) {
+    throw std::invalid_argument("Line scanner kernel not supported.");
+  }
+#ifdef VIFI_X86
+  if (kernel == Kernel::SSE2) {
+    _classify = classifySSE2;
+  } else if (kernel == Kernel::AVX2) {
+    _classify = classifyAVX2;
+  }
+#endif
+  load(0);
+}
+
+void LineScanner::load(std::size_t window) {
+  _window = window;
+  _block = window;
+  std::size_t blocks = std::min((_text.size() - window) / BLOCK, WINDOW);
+  _classify(_text.data() + window, blocks, _masks.data());
+  std::size_t rest = window + blocks * BLOCK;
+  if (blocks < WINDOW && rest < _text.size()) {
+    // Classify the end of the text in a padded copy, ignore the padding.
+    char padded[BLOCK] = {};
+    std::copy(_text.begin() + static_cast<std::ptrdiff_t>(rest), _text.end(),
+              padded);
+    _classify(padded, 1, &_masks[blocks]);
+    std::uint64_t valid = bitsBefore(std::uint64_t(1) << (_text.size() - rest));
+    _masks[blocks].newlines &= valid;
+    _masks[blocks].tabs &= valid;
+  }
+}
+
+bool LineScanner::next(Line &line) {
+  if (_pos >= _text.size()) {
+    return false;
+  }
+  std::size_t begin = _pos;
+  std::size_t separator = std::string_view::npos;
+  std::uint64_t invalid = 0;
+  for (;;) {
+    // Bits of the current line in the block, up to the next newline.
+    const Masks &masks = _masks[(_block - _window) / BLOCK];
+    std::uint64_t from = ~std::uint64_t(0) << (_pos - _block);
+    std::uint64_t newlines = masks.newlines & from;
+    std::uint64_t span = from & bitsBefore(newlines);
+    if (separator == std::string_view::npos) {
+      // Hex digits are required up to the first tabulator.
+      std::uint64_t tabs = masks.tabs & span;
+      invalid |= masks.invalid & span & bitsBefore(tabs);
+      if (tabs) {
+        separator = _block + lowestBit(tabs) - begin;
+      }
+    }
+    if (newlines) {
+      std::size_t end = _block + lowestBit(newlines);
+      _pos = end + 1;
+      line.text = _text.substr(begin, end - begin);
+      if (_pos - _block == BLOCK) {
+        nextBlock();
+      }
+      break;
+    }
+    // Continue the line in the next block, up to the end of the text.
+    _pos = _block + BLOCK;
+    if (_pos >= _text.size()) {
+      _pos = _text.size();
+      line.text = _text.substr(begin);
+      break;
+    }
+    nextBlock();
+  }
+  line.separator = separator;
+  line.hexId = !invalid && separator - 1 < MAX_ID;
+  return true;
+}
+
+void LineScanner::nextBlock() {
+  _block += BLOCK;
+  if (_block - _window == WINDOW * BLOCK) {
+    load(_block);
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef LINESCANNER_HPP
+#define LINESCANNER_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*!
+ * \class LineScanner LineScanner.hpp "ViFi/LineScanner.hpp"
+ * \brief Splits a text into lines and finds the id column of each line.
+ *
+ * The text is classified in blocks of 64 bytes into bit masks of newlines,
+ * tabulators and characters that are no hex digits, using SSE2 or AVX2 where
+ * the CPU supports it. Lines are then cut from the masks without looking at
+ * single bytes again. Every kernel yields the same lines.
+ *
+ * Typical usage goes as follows:
+ * 1. Create a scanner for the text, with the fastest kernel by default.
+ * 2. Call next() until it returns false.
+ */
+class LineScanner {
+public:
+  //! Implementation used to classify blocks of the text.
+  enum class Kernel {
+    Scalar, //!< Portable byte by byte classification.
+    SSE2,   //!< 16 bytes per instruction, x86 only.
+    AVX2    //!< 32 bytes per instruction, x86 only.
+  };
+
+  //! Line of the text, without the newline character.
+  struct Line {
+    std::string_view text; //!< Complete line.
+    std::size_t separator; //!< Position of first tabulator, npos if none.
+    bool hexId;            //!< Text before separator is 1 to 16 hex digits.
+  };
+
+  //! Bit masks of a block of 64 bytes, bit i stands for byte i.
+  struct Masks {
+    std::uint64_t newlines; //!< Newline characters.
+    std::uint64_t tabs;     //!< Tabulator characters.
+    std::uint64_t invalid;  //!< Characters that are no hex digits.
+  };
+
+  /*!
+   * \brief Check whether the CPU supports a kernel.
+   * \param kernel Kernel to check.
+   * \return True if the kernel can be used on this CPU.
+   */
+  static bool supported(Kernel kernel);
+
+  /*!
+   * \brief Get the fastest kernel the CPU supports.
+   */
+  static Kernel fastest();
+
+  /*!
+   * \brief Prepare to scan a text.
+   * \param text Text to scan, must stay valid while scanning.
+   * \param kernel Kernel to classify the text with, must be supported.
+   */
+  explicit LineScanner(std::string_view text, Kernel kernel = fastest());
+
+  /*!
+   * \brief Get the next line of the text.
+   *
+   * A text ending with a newline has no empty line at the end.
+   * \param line Holds the next line if there is one.
+   * \return False if there are no more lines.
+   */
+  bool next(Line &line);
+
+  /*!
+   * \brief Get the position after the last line returned by next().
+   */
+  std::size_t position() const { return _pos; }
+
+private:
+  // Classify a number of 64 byte blocks.
+  typedef void (*Classify)(const char *text, std::size_t blocks, Masks *masks);
+
+  static constexpr std::size_t WINDOW = 64; // Blocks classified at once.
+
+  // Classify the window of blocks starting at given position of the text.
+  void load(std::size_t window);
+  // Move on to the next block, classify the next window when needed.
+  void nextBlock();
+
+  std::string_view _text;          // Text to scan.
+  Classify _classify;              // Classification kernel.
+  std::size_t _pos;                // Begin of the next line.
+  std::size_t _window;             // Begin of the classified window.
+  std::size_t _block;              // Begin of the current block.
+  std::array<Masks, WINDOW> _masks; // Masks of the blocks in the window.
+};
+
+#endif // LINESCANNER_HPP
@@ -0,0 +1,54 @@
+#include "ViFi/MappedFile.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+// Throw a filesystem error for the current errno value.
+[[noreturn]] void throwErrno(const char *what, const fs::path &file) {
+  throw fs::filesystem_error(what, file,
+                             std::error_code(errno, std::generic_category()));
+}
+} // namespace
+
+MappedFile::MappedFile(const fs::path &file) : _data(nullptr), _size(0) {
+  int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throwErrno("Failed to open file for mapping", file);
+  }
+  struct stat status = {};
+  if (::fstat(fd, &status) != 0) {
+    int error = errno;
+    ::close(fd);
+    errno = error;
+    throwErrno("Failed to query file size", file);
+  }
+  if (!S_ISREG(status.st_mode)) {
+    // Pipes and devices report no size, their content cannot be mapped.
+    ::close(fd);
+    errno = ENODEV;
+    throwErrno("Failed to map file", file);
+  }
+  _size = static_cast<std::size_t>(status.st_size);
+  if (_size > 0) {
+    void *data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      int error = errno;
+      ::close(fd);
+      errno = error;
+      throwErrno("Failed to map file", file);
+    }
+    _data = static_cast<const char *>(data);
+  }
+  // The mapping stays valid after closing the descriptor.
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (_data) {
+    ::munmap(const_cast<char *>(_data), _size);
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#if __has_include(<filesystem>)
+#include <filesystem>
+namespace fs = std::filesystem;
+#else
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+#include <cstddef>
+
+/*!
+ * \class MappedFile MappedFile.hpp "ViFi/MappedFile.hpp"
+ * \brief Maps the content of a file read-only into memory.
+ *
+ * The content is paged in by the kernel on access, without copying it into a
+ * buffer first. It stays mapped at the same address until the object is
+ * destroyed. Changes of the file while mapped may or may not be visible.
+ */
+class MappedFile {
+public:
+  /*!
+   * \brief Map the content of a file.
+   * \param file Path of an existing and readable regular file.
+   * \exception fs::filesystem_error If the file cannot be opened or mapped,
+   *            or is no regular file.
+   */
+  explicit MappedFile(const fs::path &file);
+  ~MappedFile(); //!< Unmap the file content.
+
+  MappedFile(const MappedFile &) = delete;            //!< Not copyable.
+  MappedFile &operator=(const MappedFile &) = delete; //!< Not copyable.
+
+  /*!
+   * \brief Get the mapped file content, page aligned.
+   * \return Pointer to the first byte, null for an empty file.
+   */
+  const char *data() const { return _data; }
+
+  /*!
+   * \brief Get the size of the file content in bytes.
+   */
+  std::size_t size() const { return _size; }
+
+private:
+  const char *_data; // Mapped file content, null if empty.
+  std::size_t _size; // Size of the file content.
+};
+
+#endif // MAPPEDFILE_HPP
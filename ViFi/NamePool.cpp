@@ -0,0 +1,23 @@
+#include "ViFi/NamePool.hpp"
+#include <algorithm>
+
+std::string_view NamePool::intern(std::string_view name) {
+  if (name.empty()) {
+    return std::string_view();
+  }
+  auto found = _names.find(name);
+  if (found != _names.end()) {
+    return *found;
+  }
+  // Copy the name into the arena, its address stays fixed until clear().
+  char *data = _chars.createArray(name.size(), '\0');
+  std::copy(name.begin(), name.end(), data);
+  std::string_view stored(data, name.size());
+  _names.insert(stored);
+  return stored;
+}
+
+void NamePool::clear() noexcept {
+  _names.clear();
+  _chars.clear();
+}
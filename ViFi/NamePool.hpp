@@ -0,0 +1,45 @@
+#ifndef NAMEPOOL_HPP
+#define NAMEPOOL_HPP
+
+#include "ViFi/Arena.hpp"
+#include <cstddef>
+#include <string_view>
+#include <unordered_set>
+
+/*!
+ * \class NamePool NamePool.hpp "ViFi/NamePool.hpp"
+ * \brief Stores each distinct entry name once in shared memory blocks.
+ *
+ * Names are copied into blocks of an Arena and handed out as string views
+ * into these blocks. Adding a name that is already stored returns a view of
+ * the stored copy, so names repeated across directories cost no extra memory,
+ * and equal names from the same pool share the same data pointer.
+ * The views stay valid until clear() is called.
+ */
+class NamePool {
+public:
+  NamePool() = default; //!< Create an empty pool.
+
+  /*!
+   * \brief Get the stored copy of a name, add it if not present yet.
+   * \param name Name to be stored.
+   * \return View of the stored name, valid until clear() is called.
+   */
+  std::string_view intern(std::string_view name);
+
+  /*!
+   * \brief Get the number of distinct names in the pool.
+   */
+  std::size_t size() const { return _names.size(); }
+
+  /*!
+   * \brief Release all names.
+   */
+  void clear() noexcept;
+
+private:
+  Arena<char> _chars;                          // Storage of name characters.
+  std::unordered_set<std::string_view> _names; // Views of all stored names.
+};
+
+#endif // NAMEPOOL_HPP
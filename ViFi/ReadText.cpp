@@ -1,96 +1,324 @@
 #include "ViFi/ReadText.hpp"
 #include "ViFi/FileTree.hpp"
+#include "ViFi/LineScanner.hpp"
+#include "ViFi/MappedFile.hpp"
+#include "ViFi/WorkPool.hpp"
+#include <algorithm>
+#include <charconv>
+#include <deque>
 #include <exception>
 #include <fstream>
 #include <istream>
-#include <map>
+#include <iterator>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
-fs::path ReadText::stringToPath(const std::string &str) { return str; }
+namespace {
+constexpr std::size_t MIN_CHUNK = 1 << 20; // Minimum bytes per text chunk.
 
-void ReadText::read(const fs::path &file, FileTree &tree) {
-  try {
-    // Open text file in read mode and read its content.
-    std::ifstream in(file.string(), std::ios_base::in);
-    if (!in.is_open()) {
-      throw std::runtime_error("Unable to open file for reading.");
+// Entry line staged for sorting.
+struct Entry {
+  std::string_view path; // Entry path, without repeated separators.
+  FileTree::Id id;       // Entry id.
+  std::string_view line; // Complete line, for error messages.
+  std::size_t number;    // Line number, in the chunk until merged.
+};
+
+// Entry lines of a chunk of the text, parsed independently.
+struct Chunk {
+  std::string_view text;              // Complete lines of the chunk.
+  std::vector<Entry> entries;         // Entries sorted by path.
+  std::deque<std::string> normalized; // Paths without repeated separators.
+  std::size_t lines = 0;              // Number of lines in the chunk.
+  std::size_t errorLine = 0;          // Line of the first error, 0 if none.
+  const char *error = nullptr;        // Description of the first error.
+  std::string_view errorText;         // Line of the first error.
+};
+
+// Remove repeated separators from a path, which fs::path ignores. The
+// normalized copy is kept in storage, which is rarely needed.
+std::string_view normalize(std::string_view path,
+                           std::deque<std::string> &storage) {
+  if (path.find("//") == std::string_view::npos) {
+    return path;
+  }
+  std::string &copy = storage.emplace_back();
+  std::unique_copy(path.begin(), path.end(), std::back_inserter(copy),
+                   [](char a, char b) { return a == '/' && b == '/'; });
+  return copy;
+}
+
+// Value of a hex digit.
+FileTree::Id hexValue(char c) {
+  return static_cast<FileTree::Id>(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+}
+
+// Order of paths by their names like fs::path, a separator ends a name and
+// thus sorts before any other character.
+bool lessPath(std::string_view pathA, std::string_view pathB) {
+  auto diff = std::mismatch(pathA.begin(), pathA.end(), pathB.begin(),
+                            pathB.end());
+  if (diff.second == pathB.end()) {
+    return false;
+  } else if (diff.first == pathA.end()) {
+    return true;
+  } else if (*diff.first == '/' || *diff.second == '/') {
+    return *diff.first == '/';
+  }
+  return static_cast<unsigned char>(*diff.first) <
+         static_cast<unsigned char>(*diff.second);
+}
+
+// Split a path into its names.
+void split(std::string_view path, std::vector<std::string_view> &names) {
+  names.clear();
+  std::size_t begin = 0;
+  for (std::size_t end = path.find('/'); end != std::string_view::npos;
+       end = path.find('/', begin)) {
+    names.push_back(path.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  names.push_back(path.substr(begin));
+}
+
+// Order of entries by path.
+bool lessEntry(const Entry &entryA, const Entry &entryB) {
+  return lessPath(entryA.path, entryB.path);
+}
+
+// Parse and sort the entry lines of a chunk, stop at the first error.
+void parseChunk(Chunk &chunk) {
+  LineScanner scanner(chunk.text);
+  LineScanner::Line line = {};
+  while (scanner.next(line)) {
+    ++chunk.lines;
+    // Check presence of tab separator.
+    std::size_t separator = line.separator;
+    if (separator < std::string_view::npos) {
+      // Parse entry id, the scanner checked the digits already.
+      FileTree::Id id = 0;
+      bool valid = line.hexId;
+      if (valid) {
+        for (char c : line.text.substr(0, separator)) {
+          id = (id << 4) | hexValue(c);
+        }
+      } else {
+        const char *end = line.text.data() + separator;
+        auto parsed = std::from_chars(line.text.data(), end, id, 16);
+        valid = parsed.ec == std::errc() && parsed.ptr == end;
+      }
+      if (valid && id > 0) {
+        // Stage entry path.
+        chunk.entries.push_back(
+            {normalize(line.text.substr(separator + 1), chunk.normalized), id,
+             line.text, chunk.lines});
+      } else {
+        chunk.error = "Invalid entry id";
+      }
+    } else {
+      chunk.error = "Missing tabulator";
     }
-    read(in, tree);
-  } catch (...) {
-    std::throw_with_nested(
-        std::runtime_error("Failed to read file " + file.string()));
+    if (chunk.error) {
+      chunk.errorLine = chunk.lines;
+      chunk.errorText = line.text;
+      return;
+    }
+  }
+  // Sort entries by path unless they are sorted already, as written by
+  // WriteText. Equal paths keep their order, the later one is the duplicate.
+  if (!std::is_sorted(chunk.entries.begin(), chunk.entries.end(), lessEntry)) {
+    std::stable_sort(chunk.entries.begin(), chunk.entries.end(), lessEntry);
+  }
+}
+
+// Split the entry lines of a text into chunks at line ends.
+std::vector<Chunk> splitChunks(std::string_view text, std::size_t threads) {
+  std::size_t size = std::max(MIN_CHUNK, text.size() / (4 * threads));
+  std::vector<Chunk> chunks;
+  for (std::size_t begin = 0; begin < text.size();) {
+    std::size_t end = text.size();
+    if (begin + size < text.size()) {
+      end = std::min(text.find('\n', begin + size), end - 1) + 1;
+    }
+    chunks.emplace_back().text = text.substr(begin, end - begin);
+    begin = end;
   }
+  if (chunks.empty()) {
+    chunks.emplace_back();
+  }
+  return chunks;
 }
 
-void ReadText::read(std::istream &in, FileTree &tree) {
+// Merge the sorted entries of all chunks in text order, with line numbers.
+std::vector<Entry> mergeChunks(std::vector<Chunk> &chunks,
+                               std::size_t firstLine) {
+  if (chunks.size() == 1) {
+    for (Entry &entry : chunks.front().entries) {
+      entry.number += firstLine - 1;
+    }
+    return std::move(chunks.front().entries);
+  }
+  std::vector<Entry> entries;
+  std::vector<std::size_t> bounds = {0};
+  for (Chunk &chunk : chunks) {
+    for (Entry &entry : chunk.entries) {
+      entry.number += firstLine - 1;
+    }
+    firstLine += chunk.lines;
+    // Chunks of sorted text simply follow each other.
+    if (!entries.empty() && !chunk.entries.empty() &&
+        lessEntry(chunk.entries.front(), entries.back())) {
+      bounds.push_back(entries.size());
+    }
+    entries.insert(entries.end(), chunk.entries.begin(), chunk.entries.end());
+    std::vector<Entry>().swap(chunk.entries);
+  }
+  bounds.push_back(entries.size());
+  // Merge pairs of neighbouring sorted ranges until one is left.
+  while (bounds.size() > 2) {
+    std::vector<std::size_t> merged = {0};
+    for (std::size_t i = 2; i < bounds.size(); i += 2) {
+      std::inplace_merge(entries.begin() + bounds[i - 2],
+                         entries.begin() + bounds[i - 1],
+                         entries.begin() + bounds[i], lessEntry);
+      merged.push_back(bounds[i]);
+    }
+    if (merged.back() != entries.size()) {
+      merged.push_back(entries.size());
+    }
+    bounds.swap(merged);
+  }
+  return entries;
+}
+
+// Parse a text in the format WriteText::write() produces into a file tree.
+void parse(std::string_view text, FileTree &tree, std::size_t threads) {
   // Parse and check header line.
+  LineScanner scanner(text);
+  LineScanner::Line line = {};
   std::string header;
-  if (std::getline(in, header) && header.substr(0, 7) == "# ViFi@") {
+  if (scanner.next(line)) {
+    header = std::string(line.text);
+  }
+  if (header.substr(0, 7) == "# ViFi@") {
     // Set base path from header line.
-    fs::path base(stringToPath(header.substr(7)));
+    fs::path base(ReadText::stringToPath(header.substr(7)));
     tree.setBasePath(base);
   } else {
     throw std::runtime_error("Unknown header line " + header);
   }
 
-  // Parse entry lines.
-  std::map<fs::path, FileTree::Id> entries;
-  std::string line;
-  while (std::getline(in, line)) {
-    // Check presence of tab separator.
-    std::string::size_type separator = line.find('\t');
-    if (separator < std::string::npos) {
-      // Parse entry id.
-      std::string::size_type parsed = 0;
-      FileTree::Id id = std::stoul(line, &parsed, 16);
-      if (id > 0 && parsed == separator) {
-        // Parse entry path.
-        ++parsed;
-        fs::path relative(stringToPath(line.substr(parsed)));
-        auto insert = entries.insert({relative, id});
-        if (!insert.second) {
-          throw std::runtime_error("Duplicate path in " + line);
-        }
-      } else {
-        throw std::runtime_error("Invalid entry id in " + line);
-      }
-    } else {
-      throw std::runtime_error("Missing tabulator in " + line);
+  // Parse chunks of entry lines, on a work pool for more than one thread.
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  std::vector<Chunk> chunks =
+      splitChunks(text.substr(scanner.position()), threads);
+  if (threads > 1 && chunks.size() > 1) {
+    WorkPool pool(threads);
+    for (Chunk &chunk : chunks) {
+      pool.push([&chunk]() { parseChunk(chunk); });
+    }
+    pool.wait();
+  } else {
+    for (Chunk &chunk : chunks) {
+      parseChunk(chunk);
     }
   }
-  if (in.bad()) {
-    throw std::runtime_error("Generic error reading file.");
+  // Report the first error of the text, entry lines follow the header.
+  std::size_t firstLine = 2;
+  for (const Chunk &chunk : chunks) {
+    if (chunk.error) {
+      throw std::runtime_error(
+          std::string(chunk.error) + " in line " +
+          std::to_string(firstLine + chunk.errorLine - 1) + ": " +
+          std::string(chunk.errorText));
+    }
+    firstLine += chunk.lines;
+  }
+  std::vector<Entry> entries = mergeChunks(chunks, 2);
+
+  // Report the first duplicate line of the text.
+  const Entry *duplicate = nullptr;
+  for (std::size_t i = 1; i < entries.size(); ++i) {
+    if (entries[i].path == entries[i - 1].path &&
+        (!duplicate || entries[i].number < duplicate->number)) {
+      duplicate = &entries[i];
+    }
+  }
+  if (duplicate) {
+    // Show the path as staged, without repeated separators.
+    std::string_view line = duplicate->line;
+    throw std::runtime_error(
+        "Duplicate path in line " + std::to_string(duplicate->number) + ": " +
+        std::string(line.substr(0, line.find('\t') + 1)) +
+        std::string(duplicate->path));
   }
 
   // Feed entries into file tree.
-  fs::path previous;
+  std::vector<std::string_view> previous;
+  std::vector<std::string_view> path;
   std::vector<const FileTree::Node *> parents = {tree.baseNode()};
   // Iterate entries sorted by path.
-  for (const auto &entry : entries) {
-    fs::path path = entry.first;
-    FileTree::Id id = entry.second;
+  for (const Entry &entry : entries) {
+    split(entry.path, path);
     // Find directory level where last and current paths differ.
     FileTree::Level level = 0;
-    auto part = path.begin();
-    for (auto prev = previous.begin();
-         prev != previous.end() && part != path.end() && *prev == *part;
-         ++prev, ++part) {
+    while (level < previous.size() && level + 1 < path.size() &&
+           previous[level] == path[level]) {
       ++level;
     }
     // Truncate parent directory stack to matching level.
     parents.resize(level + 1);
     // Add intermediate directories without entry ids.
-    fs::path name = *part;
-    for (++part; part != path.end(); ++part) {
-      parents.push_back(tree.addEntry(parents.at(level), name));
-      name = *part;
-      ++level;
+    for (; level + 1 < path.size(); ++level) {
+      parents.push_back(tree.addName(parents.at(level), path[level]));
     }
     // Add leaf entry of current path with given id.
-    parents.push_back(tree.addEntry(parents.at(level), id, name));
+    parents.push_back(tree.addName(parents.at(level), entry.id, path[level]));
     // Set previous path for next iteration.
-    previous = path;
+    previous.swap(path);
+  }
+}
+} // namespace
+
+fs::path ReadText::stringToPath(const std::string &str) { return str; }
+
+void ReadText::read(const fs::path &file, FileTree &tree,
+                    std::size_t threads) {
+  try {
+    if (fs::is_regular_file(file)) {
+      // Map text file and parse its content in place.
+      MappedFile mapped(file);
+      parse(std::string_view(mapped.data(), mapped.size()), tree, threads);
+    } else {
+      // Pipes and other special files cannot be mapped, read them instead.
+      std::ifstream in(file.string(), std::ios_base::in);
+      if (!in.is_open()) {
+        throw std::runtime_error("Unable to open file for reading.");
+      }
+      read(in, tree, threads);
+    }
+  } catch (...) {
+    std::throw_with_nested(
+        std::runtime_error("Failed to read file " + file.string()));
+  }
+}
+
+void ReadText::read(std::istream &in, FileTree &tree,
+                    std::size_t threads) {
+  // Read the whole text, entry paths are parsed as views into it.
+  std::string text;
+  std::vector<char> chunk(1 << 16);
+  while (in.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) ||
+         in.gcount() > 0) {
+    text.append(chunk.data(), static_cast<std::size_t>(in.gcount()));
+  }
+  if (in.bad()) {
+    throw std::runtime_error("Generic error reading file.");
   }
+  parse(text, tree, threads);
 }
@@ -9,6 +9,7 @@ namespace fs = std::filesystem;
 namespace fs = std::experimental::filesystem;
 #endif
 
+#include <cstddef>
 #include <iosfwd>
 
 class FileTree;
@@ -34,18 +35,24 @@ public:
    * \brief Read file tree data from a text file.
    * \param file Path to an existing and readable text file.
    * \param tree File tree to store the data that is read.
+   * \param threads Number of parsing threads, 0 uses one per hardware thread.
    *
    * The format of the text file should match the output that WriteText::write()
-   * produces.
+   * produces. A regular file is mapped into memory and parsed in place, other
+   * files like pipes are read into memory first. Large files are parsed in
+   * chunks of lines on several threads if given, errors name the line number
+   * in the file either way.
    *
    * \throws std::nested_exception Wrapped-up internal exception.
    */
-  static void read(const fs::path &file, FileTree &tree);
+  static void read(const fs::path &file, FileTree &tree,
+                   std::size_t threads = 1);
 
   /*!
    * \brief Read file tree data from a text file.
    * \param in Open input stream ready to be read.
    * \param tree File tree to store the data that is read.
+   * \param threads Number of parsing threads, 0 uses one per hardware thread.
    *
    * The format of the text file should match the output that WriteText::write()
    * produces.
@@ -53,7 +60,7 @@ public:
    * \remark This method is merely intended for testing.
    * \throws std::nested_exception Wrapped-up internal exception.
    */
-  static void read(std::istream &in, FileTree &tree);
+  static void read(std::istream &in, FileTree &tree, std::size_t threads = 1);
 };
 
 #endif // READTEXT_HPP
@@ -0,0 +1,186 @@
+#include "ViFi/ScanCache.hpp"
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <system_error>
+#include <utility>
+
+namespace {
+// Identifies the cache file format.
+const char MAGIC[] = "ViFiCache2\n";
+// Changes closer than this to the scan are not trusted, in nanoseconds.
+constexpr std::int64_t GRANULARITY = 1000000000;
+// Bytes of the smallest cached entry, its flag and name length.
+constexpr std::uint64_t MIN_ENTRY = sizeof(bool) + sizeof(std::uint32_t);
+
+// Get the current time in nanoseconds.
+std::int64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Convert a timespec to nanoseconds.
+std::int64_t nanoseconds(const struct timespec &time) {
+  return static_cast<std::int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// Write a plain value in native byte order.
+template <typename T> void writeValue(std::ostream &out, const T &value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Read a plain value in native byte order.
+template <typename T> bool readValue(std::istream &in, T &value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+// Write a string with its length.
+void writeString(std::ostream &out, const std::string &str) {
+  writeValue(out, static_cast<std::uint32_t>(str.size()));
+  out.write(str.data(), static_cast<std::streamsize>(str.size()));
+}
+
+// Get the number of bytes left before the end of the stream.
+std::uint64_t bytesLeft(std::istream &in, std::streamoff end) {
+  std::streamoff position = in.tellg();
+  if (position < 0 || position > end) {
+    return 0;
+  }
+  return static_cast<std::uint64_t>(end - position);
+}
+
+// Read a string with its length, which must fit before the end.
+bool readString(std::istream &in, std::string &str, std::streamoff end) {
+  std::uint32_t size = 0;
+  if (readValue(in, size) && size <= bytesLeft(in, end)) {
+    str.resize(size);
+    return static_cast<bool>(in.read(&str[0], size));
+  }
+  return false;
+}
+} // namespace
+
+bool ScanCache::Stamp::operator==(const Stamp &other) const {
+  return device == other.device && inode == other.inode &&
+         mtime == other.mtime && ctime == other.ctime;
+}
+
+ScanCache::Stamp ScanCache::stamp(const fs::path &path) {
+  struct stat status = {};
+  if (::stat(path.c_str(), &status) != 0) {
+    throw fs::filesystem_error("Failed to query directory status", path,
+                               std::error_code(errno, std::generic_category()));
+  }
+  Stamp result;
+  result.device = static_cast<std::uint64_t>(status.st_dev);
+  result.inode = static_cast<std::uint64_t>(status.st_ino);
+  result.mtime = nanoseconds(status.st_mtim);
+  result.ctime = nanoseconds(status.st_ctim);
+  return result;
+}
+
+ScanCache::ScanCache(const fs::path &base, const std::string &settings)
+    : _base(base), _settings(settings), _scanned(now()) {}
+
+bool ScanCache::load(const fs::path &file) {
+  _directories.clear();
+  std::ifstream in(file.string(), std::ios_base::in | std::ios_base::binary);
+  // Sizes read from the file must fit into the rest of the file.
+  std::streamoff end = in.seekg(0, std::ios_base::end).tellg();
+  in.seekg(0, std::ios_base::beg);
+  std::string magic(sizeof(MAGIC) - 1, '\0');
+  std::string base;
+  std::string settings;
+  std::uint64_t count = 0;
+  if (!in.read(&magic[0], static_cast<std::streamsize>(magic.size())) ||
+      magic != MAGIC || !readString(in, base, end) || base != _base.string() ||
+      !readString(in, settings, end) || settings != _settings ||
+      !readValue(in, _scanned) || !readValue(in, count)) {
+    return false;
+  }
+  // The cache is only an accelerator, a damaged file is just not used.
+  try {
+    for (std::uint64_t i = 0; i < count; ++i) {
+      std::string key;
+      Directory directory;
+      std::uint64_t entries = 0;
+      if (!readString(in, key, end) || !readValue(in, directory.stamp) ||
+          !readValue(in, entries) || entries > bytesLeft(in, end) / MIN_ENTRY) {
+        _directories.clear();
+        return false;
+      }
+      directory.entries.resize(entries);
+      for (Entry &entry : directory.entries) {
+        if (!readValue(in, entry.directory) ||
+            !readString(in, entry.name, end)) {
+          _directories.clear();
+          return false;
+        }
+      }
+      _directories.emplace(std::move(key), std::move(directory));
+    }
+  } catch (const std::exception &) {
+    _directories.clear();
+    return false;
+  }
+  return true;
+}
+
+void ScanCache::save(const fs::path &file) const {
+  // Write to a temporary file first, replace the cache file when complete.
+  fs::path temporary = file.string() + ".new";
+  {
+    std::ofstream out(temporary.string(), std::ios_base::out |
+                                              std::ios_base::trunc |
+                                              std::ios_base::binary);
+    if (!out.is_open()) {
+      throw std::runtime_error("Unable to write scan cache " + file.string());
+    }
+    out.write(MAGIC, sizeof(MAGIC) - 1);
+    writeString(out, _base.string());
+    writeString(out, _settings);
+    writeValue(out, _scanned);
+    writeValue(out, static_cast<std::uint64_t>(_directories.size()));
+    for (const auto &directory : _directories) {
+      writeString(out, directory.first);
+      writeValue(out, directory.second.stamp);
+      writeValue(out,
+                 static_cast<std::uint64_t>(directory.second.entries.size()));
+      for (const Entry &entry : directory.second.entries) {
+        writeValue(out, entry.directory);
+        writeString(out, entry.name);
+      }
+    }
+    if (!out.flush()) {
+      throw std::runtime_error("Unable to write scan cache " + file.string());
+    }
+  }
+  fs::rename(temporary, file);
+}
+
+const ScanCache::Directory *ScanCache::find(const std::string &key,
+                                            const Stamp &stamp) const {
+  auto it = _directories.find(key);
+  if (it != _directories.end() && it->second.stamp == stamp &&
+      stamp.ctime < _scanned - GRANULARITY) {
+    return &it->second;
+  }
+  return nullptr;
+}
+
+const ScanCache::Directory *ScanCache::get(const std::string &key) const {
+  auto it = _directories.find(key);
+  return it != _directories.end() ? &it->second : nullptr;
+}
+
+void ScanCache::store(const std::string &key, Directory directory) {
+  _directories[key] = std::move(directory);
+}
+
+void ScanCache::remove(const std::string &key) { _directories.erase(key); }
+
+std::size_t ScanCache::size() const { return _directories.size(); }
@@ -0,0 +1,133 @@
+#ifndef SCANCACHE_HPP
+#define SCANCACHE_HPP
+
+#if __has_include(<filesystem>)
+#include <filesystem>
+namespace fs = std::filesystem;
+#else
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*!
+ * \class ScanCache ScanCache.hpp "ViFi/ScanCache.hpp"
+ * \brief Persistent directory listings for incremental directory scans.
+ *
+ * Stores the listing of every scanned directory together with a stamp of its
+ * device, inode, modification and status change time. A later scan reuses the
+ * cached listing of a directory as long as its stamp is unchanged, in which
+ * case the directory content cannot have changed either. Listings keep the
+ * order they were read in, so that entry ids come out the same as from a
+ * fresh scan.
+ *
+ * Directories that changed shortly before they were read are not trusted, as
+ * another change within the timestamp granularity would go unnoticed.
+ */
+class ScanCache {
+public:
+  /*!
+   * \brief Identifies the state of a directory.
+   */
+  struct Stamp {
+    std::uint64_t device = 0; //!< Device id of the filesystem.
+    std::uint64_t inode = 0;  //!< Inode number of the directory.
+    std::int64_t mtime = 0;   //!< Modification time in nanoseconds.
+    std::int64_t ctime = 0;   //!< Status change time in nanoseconds.
+
+    //! Equality comparator.
+    bool operator==(const Stamp &other) const;
+  };
+
+  /*!
+   * \brief Cached directory entry.
+   */
+  struct Entry {
+    std::string name; //!< Entry name in the directory.
+    bool directory;   //!< Set for directories.
+  };
+
+  /*!
+   * \brief Cached directory listing.
+   */
+  struct Directory {
+    Stamp stamp;                //!< State of the directory when read.
+    std::vector<Entry> entries; //!< Entries in the order they were read.
+  };
+
+  /*!
+   * \brief Get the current stamp of a directory.
+   * \param path Path of an existing directory.
+   * \return Stamp of the directory.
+   * \exception fs::filesystem_error If the directory status is unavailable.
+   */
+  static Stamp stamp(const fs::path &path);
+
+  /*!
+   * \brief Create an empty cache for a scan starting now.
+   * \param base Canonical path of the scanned base directory.
+   * \param settings Scan settings the listings depend on, like filters.
+   */
+  explicit ScanCache(const fs::path &base,
+                     const std::string &settings = std::string());
+
+  /*!
+   * \brief Load cached listings from a cache file.
+   * \param file Path of the cache file.
+   * \return False if the file is missing, invalid, or for another base or
+   *         other settings.
+   */
+  bool load(const fs::path &file);
+
+  /*!
+   * \brief Write the cached listings to a cache file.
+   * \param file Path of the cache file, which is replaced.
+   * \exception std::runtime_error If the file cannot be written.
+   */
+  void save(const fs::path &file) const;
+
+  /*!
+   * \brief Find a cached directory listing that is still valid.
+   * \param key Path of the directory relative to the base directory.
+   * \param stamp Current stamp of the directory.
+   * \return Cached listing, null if missing or outdated.
+   */
+  const Directory *find(const std::string &key, const Stamp &stamp) const;
+
+  /*!
+   * \brief Get a cached directory listing regardless of its stamp.
+   * \param key Path of the directory relative to the base directory.
+   * \return Cached listing, null if missing.
+   */
+  const Directory *get(const std::string &key) const;
+
+  /*!
+   * \brief Store a directory listing.
+   * \param key Path of the directory relative to the base directory.
+   * \param directory Listing of the directory with its stamp.
+   */
+  void store(const std::string &key, Directory directory);
+
+  /*!
+   * \brief Remove a directory listing.
+   * \param key Path of the directory relative to the base directory.
+   */
+  void remove(const std::string &key);
+
+  /*!
+   * \brief Get the number of cached directories.
+   */
+  std::size_t size() const;
+
+private:
+  fs::path _base;        // Canonical path of the scanned base directory.
+  std::string _settings; // Scan settings the listings depend on.
+  std::int64_t _scanned; // Start time of the scan in nanoseconds.
+  std::unordered_map<std::string, Directory> _directories; // Listings by key.
+};
+
+#endif // SCANCACHE_HPP
@@ -1,27 +1,629 @@
 #include "ViFi/ScanDirectory.hpp"
 #include "ViFi/FileTree.hpp"
+#include "ViFi/ScanCache.hpp"
+#include "ViFi/ScanStream.hpp"
+#include "ViFi/WorkPool.hpp"
+#include <algorithm>
 #include <exception>
+#include <fnmatch.h>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include "ViFi/IoUring.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#endif
 
 namespace {
 
-void scanDir(const fs::path &path, const FileTree::Node *dir, FileTree &tree) {
+struct Listing;
+
+// Directory entry as read from the filesystem.
+struct Entry {
+  std::string name;                 // Entry name in the directory.
+  bool directory;                   // Set for directories.
+  std::unique_ptr<Listing> listing; // Directory content, if read already.
+};
+
+// Content of a directory in the order it was read.
+struct Listing {
+  std::vector<Entry> entries; // Regular, non-hidden files and directories.
+  std::size_t syscalls = 0;   // System calls used to read the directory.
+  std::size_t saved = 0;      // System calls saved by the backend.
+  std::size_t pruned = 0;     // Entries skipped by the filters.
+  ScanCache::Stamp stamp;     // State of the directory, if cached.
+  bool cached = false;        // Set if taken from the cache.
+  bool skipped = false;       // Set if not read due to the filters.
+};
+
+// Settings and state shared by all directory reads of a scan.
+struct Context {
+  const ScanDirectory::Options &options; // Settings of the scan.
+  std::size_t baseLength;                // Length of the base path string.
+  const ScanCache *cache; // Listings of the previous scan, null if unused.
+  std::uint64_t device;   // Device of the base directory.
+
+  // Get the cache key of a directory, its path relative to the base.
+  std::string key(const fs::path &path) const {
+    return path.string().substr(baseLength);
+  }
+
+  // Get the depth of a directory below the base directory.
+  std::size_t depth(const fs::path &path) const {
+    const std::string &str = path.string();
+    std::size_t depth = 0;
+    for (std::size_t i = baseLength; i < str.size(); ++i) {
+      depth += (str[i] == '/') ? 1 : 0;
+    }
+    // Keys of a root base directory lack the leading slash.
+    return (str.size() > baseLength && str[baseLength] != '/') ? depth + 1
+                                                               : depth;
+  }
+
+  // Check whether an entry of a directory matches any of the patterns.
+  bool matches(const std::vector<std::string> &patterns, const fs::path &dir,
+               const std::string &name) const {
+    for (const std::string &pattern : patterns) {
+      if (pattern.find('/') == std::string::npos) {
+        if (::fnmatch(pattern.c_str(), name.c_str(), 0) == 0) {
+          return true;
+        }
+      } else {
+        // Patterns with slashes match the path relative to the base.
+        std::string path = key(dir) + "/" + name;
+        path.erase(0, path.find_first_not_of('/'));
+        if (::fnmatch(pattern.c_str(), path.c_str(), FNM_PATHNAME) == 0) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Check whether an entry is excluded, before querying its type.
+  bool excluded(const fs::path &dir, const std::string &name) const {
+    return !options.exclude.empty() && matches(options.exclude, dir, name);
+  }
+
+  // Check whether a regular file is included.
+  bool included(const fs::path &dir, const std::string &name) const {
+    return options.include.empty() || matches(options.include, dir, name);
+  }
+};
+
+// Drop the regular files that are not included.
+void filterIncluded(const fs::path &path, Listing &listing,
+                    const Context &context) {
+  if (!context.options.include.empty()) {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < listing.entries.size(); ++i) {
+      Entry &entry = listing.entries[i];
+      if (entry.directory || context.included(path, entry.name)) {
+        std::swap(listing.entries[kept++], entry);
+      }
+    }
+    listing.pruned += listing.entries.size() - kept;
+    listing.entries.resize(kept);
+  }
+}
+
+// Take the listing of an unchanged directory from the cache, given its stamp.
+bool readCached(const fs::path &path, Listing &listing,
+                const Context &context) {
+  const ScanCache::Directory *cached =
+      context.cache->find(context.key(path), listing.stamp);
+  if (cached) {
+    // The filesystem backend would have read the directory and its entries.
+    listing.saved += 3;
+    for (const ScanCache::Entry &entry : cached->entries) {
+      listing.entries.push_back({entry.name, entry.directory, nullptr});
+      listing.saved += entry.directory ? 3 : 2;
+    }
+    listing.cached = true;
+  }
+  return cached;
+}
+
+// Read the content of a directory through std::filesystem.
+void readDirFilesystem(const fs::path &path, Listing &listing,
+                       const Context &context) {
+  // Opening, reading until the end and closing the directory.
+  listing.syscalls += 4;
   for (const fs::directory_entry &entry : fs::directory_iterator(path)) {
+    // Skip excluded entries without querying their type.
+    if (context.excluded(path, entry.path().filename().string())) {
+      ++listing.pruned;
+      continue;
+    }
     // Only consider regular, non-hidden files and directories.
-    if ((fs::is_regular_file(entry) || fs::is_directory(entry)) &&
+    ++listing.syscalls;
+    bool regular = fs::is_regular_file(entry);
+    if (!regular) {
+      ++listing.syscalls;
+    }
+    if ((regular || fs::is_directory(entry)) &&
         entry.path().filename().string().substr(0, 1) != ".") {
-      const FileTree::Node *node = tree.addEntry(dir, entry.path().filename());
-      if (fs::is_directory(entry)) {
-        scanDir(entry.path(), node, tree);
+      ++listing.syscalls;
+      listing.entries.push_back({entry.path().filename().string(),
+                                 fs::is_directory(entry), nullptr});
+    }
+  }
+}
+
+#ifdef __linux__
+// Record layout returned by the getdents64 system call.
+struct LinuxDirent64 {
+  std::uint64_t d_ino;     // Inode number.
+  std::int64_t d_off;      // Offset to the next record.
+  unsigned short d_reclen; // Size of this record.
+  unsigned char d_type;    // Entry type, DT_UNKNOWN if not supported.
+  char d_name[1];          // Null terminated entry name.
+};
+
+// Close a file descriptor when going out of scope.
+struct Descriptor {
+  int fd; // Open file descriptor, or negative.
+  ~Descriptor() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+};
+
+// Throw a filesystem error for the last failed system call.
+[[noreturn]] void throwErrno(const std::string &what, const fs::path &path) {
+  throw fs::filesystem_error(what, path,
+                             std::error_code(errno, std::generic_category()));
+}
+
+// Status queries the Filesystem backend spends on an entry of given type.
+std::size_t filesystemQueries(unsigned char type, bool hidden) {
+  if (type == DT_REG) {
+    return hidden ? 1 : 2;
+  } else if (type == DT_DIR) {
+    return hidden ? 2 : 3;
+  }
+  return 2;
+}
+
+// Read the entries of an open directory with getdents64. Entries of unknown
+// type are added too, their indexes are collected to be resolved by the caller.
+void readEntries(int fd, const fs::path &path, Listing &listing,
+                 std::vector<std::size_t> &unknown, const Context &context) {
+  alignas(LinuxDirent64) char buffer[32768];
+  while (true) {
+    long size = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+    ++listing.syscalls;
+    if (size < 0) {
+      throwErrno("Failed to read directory", path);
+    } else if (size == 0) {
+      break;
+    }
+    for (long offset = 0; offset < size;) {
+      const auto *record = reinterpret_cast<LinuxDirent64 *>(buffer + offset);
+      offset += record->d_reclen;
+      // Skip hidden entries, "." and ".." are not even iterated otherwise.
+      const char *name = record->d_name;
+      unsigned char type = record->d_type;
+      if (name[0] == '.') {
+        if (std::strcmp(name, ".") != 0 && std::strcmp(name, "..") != 0) {
+          listing.saved += filesystemQueries(type, true);
+        }
+      } else if (context.excluded(path, name)) {
+        // Skip excluded entries without querying their type.
+        ++listing.pruned;
+      } else if (type == DT_UNKNOWN || type == DT_LNK) {
+        // Query the type later, following symbolic links.
+        unknown.push_back(listing.entries.size());
+        listing.entries.push_back({name, false, nullptr});
+      } else if (type == DT_REG || type == DT_DIR) {
+        listing.entries.push_back({name, type == DT_DIR, nullptr});
+        listing.saved += filesystemQueries(type, false);
+      } else {
+        listing.saved += filesystemQueries(type, false);
       }
     }
   }
 }
 
+// Apply the queried types of unknown entries, drop other than regular files
+// and directories.
+void resolveEntries(Listing &listing, const std::vector<std::size_t> &unknown,
+                    const std::vector<unsigned char> &types) {
+  std::vector<bool> keep(listing.entries.size(), true);
+  for (std::size_t i = 0; i < unknown.size(); ++i) {
+    listing.entries[unknown[i]].directory = (types[i] == DT_DIR);
+    keep[unknown[i]] = (types[i] == DT_REG || types[i] == DT_DIR);
+    listing.saved += filesystemQueries(types[i], false);
+  }
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < listing.entries.size(); ++i) {
+    if (keep[i]) {
+      std::swap(listing.entries[kept++], listing.entries[i]);
+    }
+  }
+  listing.entries.resize(kept);
+}
+
+// Read the content of a directory with getdents64, using the entry types.
+void readDirNative(const fs::path &path, Listing &listing,
+                   const Context &context) {
+  Descriptor dir{::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+  ++listing.syscalls;
+  if (dir.fd < 0) {
+    throwErrno("Failed to open directory", path);
+  }
+  std::vector<std::size_t> unknown;
+  readEntries(dir.fd, path, listing, unknown, context);
+  // Query unknown types one by one.
+  std::vector<unsigned char> types(unknown.size(), DT_UNKNOWN);
+  for (std::size_t i = 0; i < unknown.size(); ++i) {
+    struct statx status = {};
+    const char *name = listing.entries[unknown[i]].name.c_str();
+    ++listing.syscalls;
+    if (::statx(dir.fd, name, AT_STATX_SYNC_AS_STAT, STATX_TYPE, &status) ==
+        0) {
+      types[i] = IFTODT(status.stx_mode);
+    }
+  }
+  resolveEntries(listing, unknown, types);
+  listing.saved -= unknown.size();
+  ++listing.syscalls;
+}
+
+// Submit prepared requests and pass their results to a handler.
+void complete(IoUring &ring, unsigned count,
+              const std::function<void(std::uint64_t, int)> &handler) {
+  ring.submitAndWait(count);
+  std::uint64_t userData = 0;
+  int result = 0;
+  for (unsigned i = 0; i < count && ring.pop(userData, result); ++i) {
+    handler(userData, result);
+  }
+}
+
+// Directory of the current level in a io_uring scan.
+struct Pending {
+  Listing *listing;                 // Listing to be filled.
+  fs::path path;                    // Filesystem path of the directory.
+  int fd;                           // Open directory descriptor.
+  std::vector<std::size_t> unknown; // Entries with unknown type.
+};
+
+// Query the directory stamps with batched statx requests, if needed to take
+// unchanged directories from the cache or to skip other filesystems. Returns
+// the directories to read.
+std::vector<Pending *> stampUring(IoUring &ring, std::vector<Pending> &level,
+                                  std::size_t begin, std::size_t end,
+                                  const Context &context) {
+  std::vector<Pending *> uncached;
+  if (!context.cache && !context.options.oneFileSystem) {
+    for (std::size_t i = begin; i < end; ++i) {
+      uncached.push_back(&level[i]);
+    }
+    return uncached;
+  }
+  std::vector<struct statx> status(end - begin);
+  for (std::size_t i = begin; i < end; ++i) {
+    io_uring_sqe *sqe = ring.next();
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<std::uint64_t>(level[i].path.c_str());
+    sqe->len = STATX_BASIC_STATS;
+    sqe->off = reinterpret_cast<std::uint64_t>(&status[i - begin]);
+    sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+    sqe->user_data = i;
+  }
+  int error = 0;
+  complete(ring, static_cast<unsigned>(end - begin),
+           [&error](std::uint64_t, int result) {
+             error = result < 0 ? -result : error;
+           });
+  if (error != 0) {
+    errno = error;
+    throwErrno("Failed to query directory status", level[begin].path);
+  }
+  for (std::size_t i = begin; i < end; ++i) {
+    const struct statx &dir = status[i - begin];
+    ScanCache::Stamp &stamp = level[i].listing->stamp;
+    stamp.device = makedev(dir.stx_dev_major, dir.stx_dev_minor);
+    stamp.inode = dir.stx_ino;
+    stamp.mtime = dir.stx_mtime.tv_sec * 1000000000LL + dir.stx_mtime.tv_nsec;
+    stamp.ctime = dir.stx_ctime.tv_sec * 1000000000LL + dir.stx_ctime.tv_nsec;
+    if (context.options.oneFileSystem && stamp.device != context.device) {
+      level[i].listing->skipped = true;
+    } else if (!context.cache ||
+               !readCached(level[i].path, *level[i].listing, context)) {
+      uncached.push_back(&level[i]);
+    }
+  }
+  return uncached;
+}
+
+// Read all directories of the tree level by level, keeping many openat and
+// statx requests in flight through io_uring.
+void readUring(const fs::path &path, Listing &top, const Context &context) {
+  IoUring ring(context.options.queueDepth);
+  std::vector<Pending> level;
+  if (context.options.maxDepth > 0) {
+    level.push_back({&top, path, -1, {}});
+  } else {
+    top.skipped = true;
+  }
+  // All directories of a level have the same depth.
+  for (std::size_t depth = 1; !level.empty(); ++depth) {
+    std::vector<Pending> next;
+    for (std::size_t begin = 0; begin < level.size(); begin += ring.entries()) {
+      std::size_t end = std::min(level.size(), begin + ring.entries());
+      std::vector<Pending *> batch =
+          stampUring(ring, level, begin, end, context);
+      try {
+        // Open the directories of this batch.
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+          io_uring_sqe *sqe = ring.next();
+          sqe->opcode = IORING_OP_OPENAT;
+          sqe->fd = AT_FDCWD;
+          sqe->addr = reinterpret_cast<std::uint64_t>(batch[i]->path.c_str());
+          sqe->open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+          sqe->user_data = i;
+        }
+        int error = 0;
+        complete(ring, static_cast<unsigned>(batch.size()),
+                 [&batch, &error](std::uint64_t i, int fd) {
+                   batch[i]->fd = fd;
+                   error = fd < 0 ? -fd : error;
+                 });
+        for (Pending *dir : batch) {
+          if (dir->fd < 0) {
+            errno = error;
+            throwErrno("Failed to open directory", dir->path);
+          }
+          dir->listing->saved += 2;
+        }
+        // Read the entries, getdents64 has no io_uring counterpart.
+        std::vector<std::pair<std::size_t, std::size_t>> queries;
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+          readEntries(batch[i]->fd, batch[i]->path, *batch[i]->listing,
+                      batch[i]->unknown, context);
+          for (std::size_t u = 0; u < batch[i]->unknown.size(); ++u) {
+            queries.emplace_back(i, u);
+          }
+        }
+        // Query unknown types with up to queue depth requests in flight.
+        std::vector<std::vector<unsigned char>> types(batch.size());
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+          types[i].resize(batch[i]->unknown.size(), DT_UNKNOWN);
+        }
+        std::vector<struct statx> status(ring.entries());
+        for (std::size_t q = 0; q < queries.size(); q += ring.entries()) {
+          std::size_t count = std::min<std::size_t>(queries.size() - q,
+                                                    ring.entries());
+          for (std::size_t j = 0; j < count; ++j) {
+            const Pending &dir = *batch[queries[q + j].first];
+            std::size_t index = dir.unknown[queries[q + j].second];
+            io_uring_sqe *sqe = ring.next();
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dir.fd;
+            sqe->addr = reinterpret_cast<std::uint64_t>(
+                dir.listing->entries[index].name.c_str());
+            sqe->len = STATX_TYPE;
+            sqe->off = reinterpret_cast<std::uint64_t>(&status[j]);
+            sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+            sqe->user_data = j;
+          }
+          complete(ring, static_cast<unsigned>(count),
+                   [&](std::uint64_t j, int result) {
+                     const auto &query = queries[q + j];
+                     if (result == 0) {
+                       types[query.first][query.second] =
+                           IFTODT(status[j].stx_mode);
+                     }
+                   });
+        }
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+          resolveEntries(*batch[i]->listing, batch[i]->unknown, types[i]);
+          filterIncluded(batch[i]->path, *batch[i]->listing, context);
+        }
+      } catch (...) {
+        for (Pending *dir : batch) {
+          if (dir->fd >= 0) {
+            ::close(dir->fd);
+          }
+        }
+        throw;
+      }
+      // Close the directories of this batch.
+      for (Pending *dir : batch) {
+        io_uring_sqe *sqe = ring.next();
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = dir->fd;
+      }
+      complete(ring, static_cast<unsigned>(batch.size()),
+               [](std::uint64_t, int) {});
+      // Queue the subdirectories for the next level, unless too deep.
+      for (std::size_t i = begin; i < end && depth < context.options.maxDepth;
+           ++i) {
+        for (Entry &entry : level[i].listing->entries) {
+          if (entry.directory) {
+            entry.listing.reset(new Listing());
+            next.push_back(
+                {entry.listing.get(), level[i].path / entry.name, -1, {}});
+          }
+        }
+      }
+    }
+    level.swap(next);
+  }
+  // Account for the ring setup, submissions and teardown.
+  std::size_t calls = ring.enterCalls() + 2;
+  top.syscalls += calls;
+  top.saved -= std::min(top.saved, calls);
+}
+#endif
+
+// Read the content of a directory into a listing.
+void readDir(const fs::path &path, Listing &listing, const Context &context) {
+  // Prune directories below the maximum depth without any I/O.
+  if (context.depth(path) >= context.options.maxDepth) {
+    listing.skipped = true;
+    return;
+  }
+  if (context.cache || context.options.oneFileSystem) {
+    listing.stamp = ScanCache::stamp(path);
+    ++listing.syscalls;
+    if (context.options.oneFileSystem &&
+        listing.stamp.device != context.device) {
+      listing.skipped = true;
+      return;
+    } else if (context.cache && readCached(path, listing, context)) {
+      return;
+    }
+  }
+  switch (context.options.backend) {
+  case ScanDirectory::Filesystem:
+    readDirFilesystem(path, listing, context);
+    break;
+  case ScanDirectory::Native:
+  case ScanDirectory::Uring:
+#ifdef __linux__
+    // Single directories are read synchronously, also for io_uring.
+    readDirNative(path, listing, context);
+    break;
+#else
+    throw std::runtime_error("Native scan backend requires Linux.");
+#endif
+  default:
+    throw std::runtime_error("Unknown scan backend.");
+  }
+  filterIncluded(path, listing, context);
+}
+
+// Read all directories of the tree in parallel, in advance.
+void readParallel(const fs::path &path, Listing &listing,
+                  const Context &context) {
+  WorkPool pool(context.options.threads);
+  std::function<void(const fs::path &, Listing *)> task;
+  task = [&pool, &task, &context](const fs::path &dirPath,
+                                  Listing *dirListing) {
+    readDir(dirPath, *dirListing, context);
+    // Push subdirectories as new tasks, to be read by any worker.
+    for (Entry &entry : dirListing->entries) {
+      if (entry.directory) {
+        entry.listing.reset(new Listing());
+        Listing *subListing = entry.listing.get();
+        fs::path subPath = dirPath / entry.name;
+        pool.push([&task, subPath, subListing] { task(subPath, subListing); });
+      }
+    }
+  };
+  pool.push([&task, &path, &listing] { task(path, &listing); });
+  pool.wait();
+}
+
+// Add listed entries to the file tree in depth first order, reading missing
+// directory listings on the way. Stores the listings in the cache if given.
+void addEntries(const fs::path &path, std::unique_ptr<Listing> top,
+                const FileTree::Node *root, FileTree &tree,
+                const Context &context, ScanCache *cache,
+                ScanDirectory::Statistics &statistics) {
+  // Keep a stack of the directories in progress instead of recursion.
+  struct Frame {
+    std::unique_ptr<Listing> listing; // Content of the directory.
+    std::size_t next;                 // Next entry to be added.
+    const FileTree::Node *dir;        // File tree node of the directory.
+    fs::path path;                    // Filesystem path of the directory.
+  };
+  std::vector<Frame> stack;
+  stack.push_back({std::move(top), 0, root, path});
+  while (!stack.empty()) {
+    Frame &frame = stack.back();
+    if (frame.next < frame.listing->entries.size()) {
+      Entry &entry = frame.listing->entries[frame.next++];
+      const FileTree::Node *node = tree.addEntry(frame.dir, entry.name);
+      ++statistics.entries;
+      if (entry.directory) {
+        fs::path subPath = frame.path / entry.name;
+        std::unique_ptr<Listing> listing = std::move(entry.listing);
+        if (!listing) {
+          listing.reset(new Listing());
+          readDir(subPath, *listing, context);
+        }
+        stack.push_back({std::move(listing), 0, node, std::move(subPath)});
+      }
+    } else {
+      // Directory finished, account, cache and release its listing.
+      const Listing &listing = *frame.listing;
+      statistics.directories += listing.skipped ? 0 : 1;
+      statistics.cached += listing.cached ? 1 : 0;
+      statistics.pruned += listing.pruned + (listing.skipped ? 1 : 0);
+      statistics.syscalls += listing.syscalls;
+      statistics.saved += listing.saved;
+      if (cache && !listing.skipped) {
+        ScanCache::Directory directory;
+        directory.stamp = listing.stamp;
+        for (const Entry &entry : listing.entries) {
+          directory.entries.push_back({entry.name, entry.directory});
+        }
+        cache->store(context.key(frame.path), std::move(directory));
+      }
+      stack.pop_back();
+    }
+  }
+}
+
+// Describe the filter settings, cached listings are only valid for the same.
+std::string filterSettings(const ScanDirectory::Options &options) {
+  std::string settings;
+  for (const std::string &pattern : options.include) {
+    settings += "include " + pattern + '\n';
+  }
+  for (const std::string &pattern : options.exclude) {
+    settings += "exclude " + pattern + '\n';
+  }
+  if (options.maxDepth != std::numeric_limits<std::size_t>::max()) {
+    settings += "max-depth " + std::to_string(options.maxDepth) + '\n';
+  }
+  if (options.oneFileSystem) {
+    settings += "one-file-system\n";
+  }
+  return settings;
+}
+
 } // namespace
 
+ScanDirectory::Backend ScanDirectory::backend(const std::string &name) {
+  if (name == "filesystem") {
+    return Filesystem;
+  } else if (name == "native") {
+    return Native;
+  } else if (name == "uring") {
+    return Uring;
+  }
+  throw std::runtime_error("Unknown scan backend " + name);
+}
+
 void ScanDirectory::scan(const fs::path &directory, FileTree &tree) {
+  scan(directory, tree, Options());
+}
+
+ScanDirectory::Statistics ScanDirectory::scan(const fs::path &directory,
+                                              FileTree &tree,
+                                              const Options &options) {
+  Statistics statistics;
   try {
     if (!fs::exists(directory)) {
       throw std::runtime_error("Directory does not exist.");
@@ -30,9 +632,115 @@ void ScanDirectory::scan(const fs::path &directory, FileTree &tree) {
     }
     fs::path canonical = fs::canonical(directory);
     const FileTree::Node *root = tree.setBasePath(canonical);
-    scanDir(canonical, root, tree);
+    // Load the listings of the previous scan with the same filters, if cached.
+    std::unique_ptr<ScanCache> previous;
+    std::unique_ptr<ScanCache> current;
+    if (!options.cache.empty()) {
+      previous.reset(new ScanCache(canonical, filterSettings(options)));
+      previous->load(options.cache);
+      current.reset(new ScanCache(canonical, filterSettings(options)));
+    }
+    Context context{options, canonical.string().size(), previous.get(), 0};
+    if (options.oneFileSystem) {
+      context.device = ScanCache::stamp(canonical).device;
+    }
+    std::unique_ptr<Listing> listing(new Listing());
+    if (options.backend == Uring) {
+#ifdef __linux__
+      readUring(canonical, *listing, context);
+#else
+      throw std::runtime_error("The io_uring scan backend requires Linux.");
+#endif
+    } else if (options.threads == 1) {
+      readDir(canonical, *listing, context);
+    } else {
+      readParallel(canonical, *listing, context);
+    }
+    addEntries(canonical, std::move(listing), root, tree, context,
+               current.get(), statistics);
+    // Replace the previous listings with the current ones.
+    if (current) {
+      current->save(options.cache);
+    }
+  } catch (...) {
+    std::throw_with_nested(
+        std::runtime_error("Failed to scan directory " + directory.string()));
+  }
+  return statistics;
+}
+
+ScanDirectory::Statistics ScanDirectory::stream(const fs::path &directory,
+                                                const fs::path &file,
+                                                const Options &options) {
+  Statistics statistics;
+  try {
+    if (!fs::exists(directory)) {
+      throw std::runtime_error("Directory does not exist.");
+    } else if (!fs::is_directory(directory)) {
+      throw std::runtime_error("Not a directory");
+    }
+    fs::path canonical = fs::canonical(directory);
+    Context context{options, canonical.string().size(), nullptr, 0};
+    if (options.oneFileSystem) {
+      context.device = ScanCache::stamp(canonical).device;
+    }
+    ScanStream stream(file, canonical);
+    // Keep a stack of the directories in progress, sorted by name.
+    struct Frame {
+      Listing listing;  // Content of the directory.
+      std::size_t next; // Next entry to be written.
+      fs::path path;    // Filesystem path of the directory.
+      std::string text; // Text file path of the directory.
+    };
+    std::vector<Frame> stack;
+    auto push = [&stack, &context](fs::path path, std::string text) {
+      stack.push_back({Listing(), 0, std::move(path), std::move(text)});
+      Listing &listing = stack.back().listing;
+      readDir(stack.back().path, listing, context);
+      std::sort(listing.entries.begin(), listing.entries.end(),
+                [](const Entry &a, const Entry &b) { return a.name < b.name; });
+    };
+    push(canonical, std::string());
+    while (!stack.empty()) {
+      Frame &frame = stack.back();
+      if (frame.next < frame.listing.entries.size()) {
+        const Entry &entry = frame.listing.entries[frame.next++];
+        std::string text =
+            frame.text.empty() ? entry.name : frame.text + "/" + entry.name;
+        stream.write(text);
+        if (entry.directory) {
+          push(frame.path / entry.name, std::move(text));
+        }
+      } else {
+        const Listing &listing = frame.listing;
+        statistics.directories += listing.skipped ? 0 : 1;
+        statistics.entries += listing.entries.size();
+        statistics.pruned += listing.pruned + (listing.skipped ? 1 : 0);
+        statistics.syscalls += listing.syscalls;
+        statistics.saved += listing.saved;
+        stack.pop_back();
+      }
+    }
+    stream.finish();
   } catch (...) {
     std::throw_with_nested(
         std::runtime_error("Failed to scan directory " + directory.string()));
   }
+  return statistics;
+}
+
+ScanCache::Directory ScanDirectory::list(const fs::path &directory,
+                                         const Options &options) {
+  Options unfiltered;
+  unfiltered.backend = options.backend;
+  Context context{unfiltered, directory.string().size(), nullptr, 0};
+  Listing listing;
+  listing.stamp = ScanCache::stamp(directory);
+  readDir(directory, listing, context);
+  ScanCache::Directory result;
+  result.stamp = listing.stamp;
+  for (const Entry &entry : listing.entries) {
+    result.entries.push_back({entry.name, entry.directory});
+  }
+  return result;
 }
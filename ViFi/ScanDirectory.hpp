@@ -9,6 +9,12 @@ namespace fs = std::filesystem;
 namespace fs = std::experimental::filesystem;
 #endif
 
+#include "ViFi/ScanCache.hpp"
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
 class FileTree;
 
 /*!
@@ -21,6 +27,56 @@ class FileTree;
  */
 class ScanDirectory {
 public:
+  //! Implementation used to read the directories.
+  enum Backend {
+    Filesystem, //!< Portable std::filesystem directory iteration.
+    Native,     //!< Linux getdents64 with entry types, statx if unknown.
+    Uring       //!< Linux io_uring batches of openat and statx per level.
+  };
+
+  /*!
+   * \brief Settings that control how a directory is scanned.
+   */
+  struct Options {
+    //! Number of scanner threads, 0 uses one per hardware thread.
+    std::size_t threads = 1;
+    //! Implementation used to read the directories.
+    Backend backend = Filesystem;
+    //! Requests in flight for the Uring backend, which ignores threads.
+    unsigned queueDepth = 64;
+    //! File to cache directory listings for the next scan, empty if unused.
+    fs::path cache;
+    //! Glob patterns of regular files to keep, all files if empty.
+    std::vector<std::string> include;
+    //! Glob patterns of files and directories to skip with their content.
+    std::vector<std::string> exclude;
+    //! Maximum depth of entries, deeper directories are not read.
+    std::size_t maxDepth = std::numeric_limits<std::size_t>::max();
+    //! Do not read directories on other filesystems than the scanned one.
+    bool oneFileSystem = false;
+  };
+
+  /*!
+   * \brief Counters collected while scanning a directory.
+   */
+  struct Statistics {
+    std::size_t directories = 0; //!< Number of directories read.
+    std::size_t cached = 0;      //!< Directories taken from the cache.
+    std::size_t pruned = 0;      //!< Entries and directories pruned by filters.
+    std::size_t entries = 0;     //!< Number of entries added to the tree.
+    std::size_t syscalls = 0;    //!< System calls used to read directories.
+    //! System calls saved compared to the Filesystem backend.
+    std::size_t saved = 0;
+  };
+
+  /*!
+   * \brief Parse the name of a scan backend.
+   * \param name Backend name, "filesystem", "native" or "uring".
+   * \return Backend of the given name.
+   * \exception std::runtime_error On unknown backend names.
+   */
+  static Backend backend(const std::string &name);
+
   /*!
    * \brief Scan the given directory and load its filesystem structure.
    *
@@ -33,6 +89,68 @@ public:
    * \exception std::nested_exception Wrapped-up internal exception.
    */
   static void scan(const fs::path &directory, FileTree &tree);
+
+  /*!
+   * \brief Scan the given directory with custom settings.
+   *
+   * With more than one thread, the directories are read in parallel and the
+   * results are added to the file tree in the same order as a serial scan
+   * would, thus resulting in the same entry ids.
+   *
+   * With a cache file, only directories that changed since the previous scan
+   * are read, the listings of all others are taken from the cache. Entry ids
+   * are the same as from a scan without cache.
+   *
+   * Filters are applied before any I/O on the pruned entries. Patterns without
+   * a slash match the entry name, others the path relative to the scanned
+   * directory, see fnmatch(3). Excluded directories are skipped with their
+   * content. Directories at maximum depth or on another filesystem are added
+   * as entries, but not read.
+   *
+   * The system calls of the Filesystem backend are counted as one status
+   * query per type check, which is what the standard library implementations
+   * do, plus opening, reading and closing each directory.
+   *
+   * \param directory Path of the directory to be scanned.
+   * \param tree File tree to store the directory scan results.
+   * \param options Settings for the directory scan.
+   * \return Counters collected during the scan.
+   * \exception std::nested_exception Wrapped-up internal exception.
+   */
+  static Statistics scan(const fs::path &directory, FileTree &tree,
+                         const Options &options);
+
+  /*!
+   * \brief Scan the given directory and write it to a text file on the fly.
+   *
+   * Reads the directories in text file order and writes their entries while
+   * scanning, through a ScanStream. No file tree is built, the memory used is
+   * bounded by the directory depth times the directory size. Entry ids are
+   * assigned in text file order, which differs from scan(). Directories are
+   * read one at a time, the threads setting and the cache are not used.
+   *
+   * \param directory Path of the directory to be scanned.
+   * \param file Location for the output text file.
+   * \param options Settings for the directory scan.
+   * \return Counters collected during the scan.
+   * \exception std::nested_exception Wrapped-up internal exception.
+   */
+  static Statistics stream(const fs::path &directory, const fs::path &file,
+                           const Options &options);
+
+  /*!
+   * \brief Read the listing of a single directory, not recursing into it.
+   *
+   * The directory stamp is taken before reading, so that later changes to the
+   * directory always change the stamp. Hidden entries are skipped as in scan().
+   *
+   * \param directory Path of the directory to be read.
+   * \param options Settings for the backend, all other settings are ignored.
+   * \return Stamp and entries of the directory in the order they were read.
+   * \exception fs::filesystem_error If the directory cannot be read.
+   */
+  static ScanCache::Directory list(const fs::path &directory,
+                                   const Options &options);
 };
 
 #endif // SCANDIRECTORY_HPP
@@ -0,0 +1,115 @@
+#include "ViFi/ScanStream.hpp"
+#include "ViFi/WriteText.hpp"
+#include <iomanip>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+// Number of entries handed over to the writer at once.
+constexpr std::size_t BATCH_SIZE = 1024;
+// Maximum number of batches waiting to be written.
+constexpr std::size_t QUEUE_SIZE = 16;
+
+// Compute the number of hex digits needed to express an entry id.
+constexpr int hexWidth(std::size_t id) {
+  if (id > 0) {
+    return hexWidth(id >> 8) + 2;
+  }
+  return 0;
+}
+} // namespace
+
+ScanStream::ScanStream(const fs::path &file, const fs::path &base)
+    : _out(file.string(), std::ios_base::out | std::ios_base::trunc),
+      _count(0), _closed(false) {
+  if (!_out.is_open()) {
+    throw std::runtime_error("Unable to open file " + file.string() +
+                             " for writing.");
+  }
+  _out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+  _out << "# ViFi@" << WriteText::pathToString(base) << '\n';
+  _batch.reserve(BATCH_SIZE);
+  _writer = std::thread(&ScanStream::run, this);
+}
+
+ScanStream::~ScanStream() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    _queue.clear();
+  }
+  _changed.notify_all();
+  if (_writer.joinable()) {
+    _writer.join();
+  }
+}
+
+void ScanStream::write(std::string path) {
+  _batch.push_back(std::move(path));
+  ++_count;
+  if (_batch.size() >= BATCH_SIZE) {
+    flush();
+  }
+}
+
+std::size_t ScanStream::finish() {
+  flush();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+  }
+  _changed.notify_all();
+  _writer.join();
+  if (_error) {
+    std::rethrow_exception(_error);
+  }
+  _out.flush();
+  return _count;
+}
+
+void ScanStream::flush() {
+  std::vector<std::string> batch;
+  batch.reserve(BATCH_SIZE);
+  std::swap(batch, _batch);
+  std::unique_lock<std::mutex> lock(_mutex);
+  // Wait for space in the queue, unless the writer has given up.
+  _changed.wait(lock,
+                [this] { return _queue.size() < QUEUE_SIZE || _error; });
+  if (_error) {
+    std::rethrow_exception(_error);
+  }
+  _queue.push_back(std::move(batch));
+  lock.unlock();
+  _changed.notify_all();
+}
+
+void ScanStream::run() {
+  std::size_t id = 0;
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _changed.wait(lock, [this] { return !_queue.empty() || _closed; });
+    if (_queue.empty()) {
+      break;
+    }
+    std::vector<std::string> batch = std::move(_queue.front());
+    _queue.pop_front();
+    lock.unlock();
+    _changed.notify_all();
+    try {
+      // Ids follow the text file order, written with minimal width.
+      for (const std::string &path : batch) {
+        ++id;
+        _out << std::right << std::setfill('0') << std::setw(hexWidth(id))
+             << std::hex << id << '\t' << path << '\n';
+      }
+    } catch (...) {
+      lock.lock();
+      _error = std::current_exception();
+      _queue.clear();
+      lock.unlock();
+      _changed.notify_all();
+      return;
+    }
+    lock.lock();
+  }
+}
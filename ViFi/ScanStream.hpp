@@ -0,0 +1,87 @@
+#ifndef SCANSTREAM_HPP
+#define SCANSTREAM_HPP
+
+#if __has_include(<filesystem>)
+#include <filesystem>
+namespace fs = std::filesystem;
+#else
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+ * \class ScanStream ScanStream.hpp "ViFi/ScanStream.hpp"
+ * \brief Write a text file on a separate thread while the directory is read.
+ *
+ * Takes entry paths in their final text file order and writes them on a
+ * writer thread, so that reading directories and writing the text file
+ * overlap. Entries are passed through a bounded queue in batches, the memory
+ * used does not depend on the number of entries.
+ *
+ * Entry ids are assigned in text file order, starting at 1. As the number of
+ * entries is unknown in advance, every id is written with as many hex digits
+ * as it needs, rounded up to full bytes.
+ *
+ * Typical usage goes as follows:
+ * 1. Add all entry paths in text file order through write().
+ * 2. Call finish() to wait until the text file is complete.
+ */
+class ScanStream {
+public:
+  /*!
+   * \brief Open the text file and start the writer thread.
+   * \param file Location for the output text file, overwritten if existing.
+   * \param base Path of the scanned base directory, written to the header.
+   * \exception std::runtime_error If the file cannot be opened.
+   */
+  ScanStream(const fs::path &file, const fs::path &base);
+  ~ScanStream(); //!< Stop the writer thread, the text file is incomplete.
+
+  ScanStream(const ScanStream &) = delete;            //!< Not copyable.
+  ScanStream &operator=(const ScanStream &) = delete; //!< Not copyable.
+
+  /*!
+   * \brief Add the next entry to the text file.
+   *
+   * Blocks while the queue is full.
+   *
+   * \param path Entry path relative to the base directory, '/' separated.
+   * \exception std::runtime_error If the writer thread failed.
+   */
+  void write(std::string path);
+
+  /*!
+   * \brief Write the remaining entries and close the text file.
+   * \return Number of entries written.
+   * \exception std::runtime_error If writing the file failed.
+   */
+  std::size_t finish();
+
+private:
+  // Hand the current batch over to the writer thread.
+  void flush();
+  // Writer thread loop, writes batches until the queue is closed.
+  void run();
+
+  std::ofstream _out;               // Output text file.
+  std::vector<std::string> _batch;  // Entries not yet handed over.
+  std::size_t _count;               // Number of entries added.
+  std::mutex _mutex;                // Protects the members below.
+  std::condition_variable _changed; // Signals queue changes.
+  std::deque<std::vector<std::string>> _queue; // Batches to be written.
+  bool _closed;                                // Set when no batches follow.
+  std::exception_ptr _error;                   // Failure of the writer.
+  std::thread _writer;                         // Writer thread.
+};
+
+#endif // SCANSTREAM_HPP
@@ -0,0 +1,93 @@
+#include "ViFi/TreeView.hpp"
+#include "ViFi/FileTree.hpp"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+// Check whether a path is below or equal to a directory path.
+bool isWithin(std::string_view path, std::string_view dir) {
+  return path.substr(0, dir.size()) == dir &&
+         (path.size() == dir.size() || path[dir.size()] == '/');
+}
+
+// Keep the original entries below a node outside the view, iteratively so
+// that deep trees do not exhaust the stack.
+void keepNode(const TreeView &view, FileTree &tree,
+              const FileTree::Node *node) {
+  // Entries left in a directory and the size of its path.
+  struct Frame {
+    FileTree::Range range;
+    std::size_t size;
+  };
+  std::string path;
+  std::vector<Frame> stack = {{tree.entries(node), 0}};
+  while (!stack.empty()) {
+    Frame &frame = stack.back();
+    if (frame.range.begin == frame.range.end) {
+      stack.pop_back();
+      continue;
+    }
+    const FileTree::Node *sub = *(frame.range.begin++);
+    path.resize(frame.size);
+    if (frame.size > 0) {
+      path += '/';
+    }
+    path += FileTree::nodeNameView(sub);
+    // Entries of the view come with everything below them.
+    if (!view.contains(path)) {
+      tree.keepEntry(sub);
+      stack.push_back({tree.entries(sub), path.size()});
+    }
+  }
+}
+} // namespace
+
+TreeView::TreeView() : _matching(false) {}
+
+void TreeView::setSubtree(const std::string &path) {
+  fs::path normal = fs::path(path).lexically_normal();
+  std::string subtree = normal.generic_string();
+  while (!subtree.empty() && subtree.back() == '/') {
+    subtree.pop_back();
+  }
+  if (normal.is_absolute() || subtree.empty() || subtree == "." ||
+      subtree == ".." || subtree.substr(0, 3) == "../") {
+    throw std::runtime_error("Invalid view subtree " + path);
+  }
+  _subtree = subtree;
+}
+
+void TreeView::setMatch(const std::string &pattern) {
+  try {
+    auto flags =
+        std::regex::ECMAScript | std::regex::nosubs | std::regex::optimize;
+    _pattern = std::regex(pattern, flags);
+    _matching = true;
+  } catch (const std::regex_error &) {
+    throw std::runtime_error("Invalid view pattern " + pattern);
+  }
+}
+
+bool TreeView::whole() const { return _subtree.empty() && !_matching; }
+
+bool TreeView::contains(std::string_view path) const {
+  if (!_subtree.empty() && !isWithin(path, _subtree)) {
+    return false;
+  }
+  return !_matching || std::regex_search(path.begin(), path.end(), _pattern);
+}
+
+bool TreeView::reaches(std::string_view path) const {
+  if (!_subtree.empty()) {
+    // Only the directories leading to the subtree and the subtree itself.
+    return isWithin(path, _subtree) || isWithin(_subtree, path);
+  }
+  return true;
+}
+
+void TreeView::keepOutside(FileTree &tree) const {
+  if (!whole()) {
+    keepNode(*this, tree, tree.baseNode());
+  }
+}
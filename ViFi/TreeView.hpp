@@ -0,0 +1,84 @@
+#ifndef TREEVIEW_HPP
+#define TREEVIEW_HPP
+
+#include <regex>
+#include <string>
+#include <string_view>
+
+class FileTree;
+
+/*!
+ * \class TreeView TreeView.hpp "ViFi/TreeView.hpp"
+ * \brief Selects the part of a file tree that is presented for editing.
+ *
+ * A view is either a subtree, the entry at a path and everything below it, or
+ * all entries whose path matches a regular expression, again with everything
+ * below them. Paths are relative to the base directory and '/' separated, as
+ * in the text file. An entry of the view thus never has hidden entries below
+ * it, which deleting or moving the entry would take along unseen.
+ *
+ * Entries outside the view are not written to the text file. When the edited
+ * view is read back, keepOutside() keeps them unchanged at their original
+ * paths, as if they had been part of the text file without any change.
+ *
+ * Typical usage goes as follows:
+ * 1. Scan: write the view of the original tree, see WriteText::write().
+ * 2. Move: read the original tree and the edited view into the file tree.
+ * 3. Move: merge back the entries outside the view with keepOutside().
+ */
+class TreeView {
+public:
+  TreeView(); //!< View of the whole tree.
+
+  /*!
+   * \brief Restrict the view to a subtree.
+   * \param path Relative path of the subtree entry.
+   * \exception std::runtime_error If the path is absolute or leaves the base.
+   */
+  void setSubtree(const std::string &path);
+
+  /*!
+   * \brief Restrict the view to entries with matching paths.
+   * \param pattern ECMAScript regular expression, searched in the paths.
+   * \exception std::runtime_error If the pattern is invalid.
+   */
+  void setMatch(const std::string &pattern);
+
+  /*!
+   * \brief Check whether the view contains the whole tree.
+   */
+  bool whole() const;
+
+  /*!
+   * \brief Check whether an entry is part of the view with all entries below.
+   *
+   * Only meant for entries whose parent directory is not part of the view,
+   * the entries below an entry of the view are not checked again.
+   * \param path Relative path of the entry.
+   */
+  bool contains(std::string_view path) const;
+
+  /*!
+   * \brief Check whether entries below an entry may be part of the view.
+   * \param path Relative path of the entry.
+   * \return False if none of the entries below can be part of the view.
+   */
+  bool reaches(std::string_view path) const;
+
+  /*!
+   * \brief Keep all original entries outside the view at their paths.
+   *
+   * Call after the edited view is read into the file tree as target.
+   * \param tree File tree with original and target entries.
+   * \exception std::runtime_error If the view moves an entry to the path of
+   *            an entry outside the view.
+   */
+  void keepOutside(FileTree &tree) const;
+
+private:
+  std::string _subtree; // Relative path of the subtree, empty for all.
+  bool _matching;       // Set if restricted by a pattern.
+  std::regex _pattern;  // Pattern searched in the paths.
+};
+
+#endif // TREEVIEW_HPP
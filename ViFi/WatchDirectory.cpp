@@ -0,0 +1,548 @@
+#include "ViFi/WatchDirectory.hpp"
+#include "ViFi/FileTree.hpp"
+#include "ViFi/WriteText.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+// Name of the socket in the watched directory, hidden from scans.
+const char SOCKET_NAME[] = ".ViFiWatch";
+// Events that change the entries of a watched directory.
+constexpr std::uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                     IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK;
+// Seconds to wait for a client to send its request.
+constexpr long REQUEST_TIMEOUT = 5;
+
+// Set by the signal handler to stop serving requests.
+volatile std::sig_atomic_t stopRequested = 0;
+
+// Signal handler requesting to stop.
+void requestStop(int) { stopRequested = 1; }
+
+// Throw a filesystem error for the last failed system call.
+[[noreturn]] void throwErrno(const char *what, const fs::path &path) {
+  throw fs::filesystem_error(what, path,
+                             std::error_code(errno, std::generic_category()));
+}
+
+// Describe the last failed system call on a path.
+std::string errnoMessage(const char *what, const fs::path &path) {
+  return fs::filesystem_error(what, path,
+                              std::error_code(errno, std::generic_category()))
+      .what();
+}
+
+// Check whether a directory is gone, its parent has an event pending then.
+bool isGone(const std::error_code &error) {
+  return error == std::errc::no_such_file_or_directory ||
+         error == std::errc::not_a_directory;
+}
+
+// Fill a unix socket address, check the path length.
+sockaddr_un socketAddress(const fs::path &path) {
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  const std::string &name = path.string();
+  if (name.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + name);
+  }
+  std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+  return address;
+}
+
+// Connect to a unix socket, returns -1 if nobody listens.
+int connectSocket(const fs::path &path) {
+  sockaddr_un address = socketAddress(path);
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr *>(&address),
+                           sizeof(address)) != 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+// Send a complete message, returns false on failure.
+bool sendAll(int fd, const std::string &message) {
+  std::size_t sent = 0;
+  while (sent < message.size()) {
+    ssize_t size = ::send(fd, message.data() + sent, message.size() - sent,
+                          MSG_NOSIGNAL);
+    if (size < 0 && errno != EINTR) {
+      return false;
+    }
+    sent += size > 0 ? static_cast<std::size_t>(size) : 0;
+  }
+  return true;
+}
+
+// Receive until end of stream or a newline, returns false on failure.
+bool receiveLine(int fd, std::string &line) {
+  char buffer[4096];
+  while (line.find('\n') == std::string::npos) {
+    ssize_t size = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (size < 0 && errno == EINTR) {
+      continue;
+    } else if (size <= 0) {
+      return size == 0;
+    }
+    line.append(buffer, static_cast<std::size_t>(size));
+  }
+  line.erase(line.find('\n'));
+  return true;
+}
+
+// Get the user id of the process connected to a socket.
+bool peerUser(int fd, uid_t &uid) {
+  ucred credentials = {};
+  socklen_t size = sizeof(credentials);
+  if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) != 0) {
+    return false;
+  }
+  uid = credentials.uid;
+  return true;
+}
+
+// Check that a client may have the text file written to a path: a new or
+// regular file, directly in a directory the client owns.
+void checkTarget(const fs::path &file, uid_t uid) {
+  if (!file.is_absolute() || !file.has_filename()) {
+    throw std::runtime_error("Invalid text file path " + file.string());
+  }
+  struct stat status = {};
+  if (::lstat(file.parent_path().c_str(), &status) != 0 ||
+      !S_ISDIR(status.st_mode) || status.st_uid != uid) {
+    throw std::runtime_error("Text file directory not owned by the client: " +
+                             file.parent_path().string());
+  }
+  if (::lstat(file.c_str(), &status) == 0) {
+    if (!S_ISREG(status.st_mode) || status.st_uid != uid) {
+      throw std::runtime_error("Text file is no regular file of the client: " +
+                               file.string());
+    }
+  } else if (errno != ENOENT) {
+    throwErrno("Failed to check text file", file);
+  }
+}
+
+// Collect the messages of a possibly nested exception.
+std::string describe(const std::exception &exception) {
+  std::string message = exception.what();
+  try {
+    std::rethrow_if_nested(exception);
+  } catch (const std::exception &e) {
+    message += " - " + describe(e);
+  } catch (...) {
+  }
+  return message;
+}
+} // namespace
+
+fs::path WatchDirectory::socketPath(const fs::path &directory) {
+  return directory / SOCKET_NAME;
+}
+
+bool WatchDirectory::request(const fs::path &directory, const fs::path &file) {
+  std::error_code error;
+  fs::path canonical = fs::canonical(directory, error);
+  if (error || !fs::exists(socketPath(canonical), error)) {
+    return false;
+  }
+  int fd = connectSocket(socketPath(canonical));
+  if (fd < 0) {
+    return false;
+  }
+  // Paths are relative to the watch process, send the absolute path.
+  std::string reply;
+  bool ok = sendAll(fd, fs::absolute(file).string() + "\n") &&
+            receiveLine(fd, reply);
+  ::close(fd);
+  if (!ok) {
+    throw std::runtime_error("Lost connection to watch process.");
+  } else if (reply != "OK") {
+    throw std::runtime_error(reply);
+  }
+  return true;
+}
+
+WatchDirectory::WatchDirectory(const fs::path &directory,
+                               const ScanDirectory::Options &options)
+    : _base(directory), _options(options), _listings(directory),
+      _inotify(-1), _socket(-1), _overflow(false) {
+  try {
+    _base = fs::canonical(directory);
+    _listings = ScanCache(_base);
+    _inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify < 0) {
+      throwErrno("Failed to initialize inotify", _base);
+    }
+    add("");
+    // Fail right away if the directory cannot be watched completely.
+    if (!_failed.empty()) {
+      throw std::runtime_error(_failed.begin()->second);
+    }
+  } catch (...) {
+    if (_inotify >= 0) {
+      ::close(_inotify);
+    }
+    std::throw_with_nested(
+        std::runtime_error("Failed to watch directory " + directory.string()));
+  }
+}
+
+WatchDirectory::~WatchDirectory() {
+  if (_socket >= 0) {
+    ::close(_socket);
+    ::unlink(socketPath(_base).c_str());
+  }
+  ::close(_inotify);
+}
+
+void WatchDirectory::add(const std::string &key) {
+  std::vector<std::string> stack{key};
+  while (!stack.empty()) {
+    std::string dir = std::move(stack.back());
+    stack.pop_back();
+    // Watch before reading, so that no change goes unnoticed.
+    fs::path path = _base.string() + dir;
+    int wd = ::inotify_add_watch(_inotify, path.c_str(), WATCH_MASK);
+    if (wd < 0 && (errno == ENOENT || errno == ENOTDIR)) {
+      // Removed in the meantime, the parent directory has an event pending.
+      continue;
+    } else if (wd < 0) {
+      // Keep watching the rest, requests report the failure until it is gone.
+      _failed[dir] = errnoMessage(
+          errno == ENOSPC ? "Failed to watch directory, check fs.inotify limits"
+                          : "Failed to watch directory",
+          path);
+      continue;
+    }
+    // A moved directory keeps its watch, forget the old location.
+    auto known = _keys.find(wd);
+    if (known != _keys.end() && known->second != dir) {
+      _watches.erase(known->second);
+    }
+    _keys[wd] = dir;
+    _watches[dir] = wd;
+    ScanCache::Directory listing;
+    try {
+      listing = ScanDirectory::list(path, _options);
+    } catch (const fs::filesystem_error &e) {
+      if (!isGone(e.code())) {
+        _failed[dir] = e.what();
+      }
+      continue;
+    }
+    _failed.erase(dir);
+    for (const ScanCache::Entry &entry : listing.entries) {
+      if (entry.directory) {
+        stack.push_back(dir + "/" + entry.name);
+      }
+    }
+    _listings.store(dir, std::move(listing));
+  }
+}
+
+void WatchDirectory::drop(const std::string &key) {
+  std::vector<std::string> stack{key};
+  while (!stack.empty()) {
+    std::string dir = std::move(stack.back());
+    stack.pop_back();
+    if (const ScanCache::Directory *listing = _listings.get(dir)) {
+      for (const ScanCache::Entry &entry : listing->entries) {
+        if (entry.directory) {
+          stack.push_back(dir + "/" + entry.name);
+        }
+      }
+    }
+    auto watch = _watches.find(dir);
+    if (watch != _watches.end()) {
+      // Fails harmlessly if the kernel already removed the watch.
+      ::inotify_rm_watch(_inotify, watch->second);
+      _keys.erase(watch->second);
+      _watches.erase(watch);
+    }
+    _listings.remove(dir);
+    _dirty.erase(dir);
+    _failed.erase(dir);
+  }
+}
+
+void WatchDirectory::refresh(const std::string &key) {
+  const ScanCache::Directory *previous = _listings.get(key);
+  if (!previous) {
+    return;
+  }
+  fs::path path = _base.string() + key;
+  ScanCache::Directory listing;
+  try {
+    listing = ScanDirectory::list(path, _options);
+  } catch (const fs::filesystem_error &e) {
+    // If removed, the parent directory has an event pending. Otherwise the
+    // subtree is unknown now and requests fail until it can be read again.
+    if (!isGone(e.code())) {
+      drop(key);
+      _failed[key] = e.what();
+    }
+    return;
+  }
+  if (listing.stamp.device != previous->stamp.device ||
+      listing.stamp.inode != previous->stamp.inode) {
+    // Replaced by another directory, read it from scratch.
+    drop(key);
+    add(key);
+    return;
+  }
+  // Drop subdirectories that are gone, add new ones.
+  std::set<std::string> current;
+  for (const ScanCache::Entry &entry : listing.entries) {
+    if (entry.directory) {
+      current.insert(entry.name);
+    }
+  }
+  std::vector<std::string> gone;
+  for (const ScanCache::Entry &entry : previous->entries) {
+    if (entry.directory && !current.count(entry.name)) {
+      gone.push_back(key + "/" + entry.name);
+    }
+  }
+  for (const std::string &sub : gone) {
+    drop(sub);
+  }
+  _listings.store(key, std::move(listing));
+  for (const std::string &name : current) {
+    if (!_listings.get(key + "/" + name)) {
+      add(key + "/" + name);
+    }
+  }
+}
+
+void WatchDirectory::process() {
+  alignas(inotify_event) char buffer[65536];
+  while (true) {
+    ssize_t size = ::read(_inotify, buffer, sizeof(buffer));
+    if (size < 0 && errno == EINTR) {
+      continue;
+    } else if (size < 0 && errno == EAGAIN) {
+      break;
+    } else if (size <= 0) {
+      throwErrno("Failed to read inotify events", _base);
+    }
+    for (ssize_t offset = 0; offset < size;) {
+      const auto *event = reinterpret_cast<inotify_event *>(buffer + offset);
+      offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+      if (event->mask & IN_Q_OVERFLOW) {
+        _overflow = true;
+        continue;
+      }
+      auto known = _keys.find(event->wd);
+      if (known == _keys.end()) {
+        continue;
+      } else if (event->mask & IN_IGNORED) {
+        // Directory removed, the kernel dropped the watch already.
+        _watches.erase(known->second);
+        _keys.erase(known);
+        continue;
+      }
+      // Changes to hidden entries are invisible in the tree.
+      if (event->len > 0 && event->name[0] != '.') {
+        _dirty.insert(known->second);
+        if ((event->mask & IN_ISDIR) &&
+            (event->mask & (IN_DELETE | IN_MOVED_FROM))) {
+          // The name may be reused by another directory, forget it now.
+          drop(known->second + "/" + event->name);
+        }
+      }
+    }
+  }
+}
+
+void WatchDirectory::update() {
+  process();
+  if (_overflow) {
+    // Events were lost, compare the stamps of all watched directories.
+    _overflow = false;
+    for (const auto &watch : _watches) {
+      const ScanCache::Directory *listing = _listings.get(watch.first);
+      try {
+        if (!listing ||
+            !(ScanCache::stamp(_base.string() + watch.first) ==
+              listing->stamp)) {
+          _dirty.insert(watch.first);
+        }
+      } catch (const fs::filesystem_error &) {
+        _dirty.insert(watch.first);
+      }
+    }
+    // Directories without listing need to be read by their parent.
+    _dirty.insert("");
+  }
+  // Parents sort before their subdirectories and are refreshed first.
+  while (!_dirty.empty()) {
+    std::string key = *_dirty.begin();
+    _dirty.erase(_dirty.begin());
+    try {
+      refresh(key);
+    } catch (...) {
+      // Read it again with the next update.
+      _dirty.insert(key);
+      throw;
+    }
+  }
+  // Try again to watch and read the directories that failed before.
+  std::vector<std::string> failed;
+  for (const auto &failure : _failed) {
+    failed.push_back(failure.first);
+  }
+  for (const std::string &key : failed) {
+    _failed.erase(key);
+    add(key);
+  }
+}
+
+std::size_t WatchDirectory::build(FileTree &tree) {
+  update();
+  struct Frame {
+    const ScanCache::Directory *listing; // Content of the directory.
+    std::size_t next;                    // Next entry to be added.
+    const FileTree::Node *dir;           // File tree node of the directory.
+    std::string key;                     // Key of the directory.
+  };
+  // A directory without listing could not be read, like a scan would fail.
+  auto listing = [this](const std::string &key) {
+    const ScanCache::Directory *found = _listings.get(key);
+    if (!found) {
+      auto failure = _failed.find(key);
+      throw std::runtime_error(failure != _failed.end()
+                                   ? failure->second
+                                   : "Directory not read: " + _base.string() +
+                                         key);
+    }
+    return found;
+  };
+  std::size_t entries = 0;
+  std::vector<Frame> stack;
+  stack.push_back({listing(""), 0, tree.setBasePath(_base), ""});
+  while (!stack.empty()) {
+    Frame &frame = stack.back();
+    if (frame.next < frame.listing->entries.size()) {
+      const ScanCache::Entry &entry = frame.listing->entries[frame.next++];
+      const FileTree::Node *node = tree.addEntry(frame.dir, entry.name);
+      ++entries;
+      if (entry.directory) {
+        std::string key = frame.key + "/" + entry.name;
+        const ScanCache::Directory *sub = listing(key);
+        stack.push_back({sub, 0, node, std::move(key)});
+      }
+    } else {
+      stack.pop_back();
+    }
+  }
+  return entries;
+}
+
+void WatchDirectory::serve() {
+  fs::path path = socketPath(_base);
+  sockaddr_un address = socketAddress(path);
+  int running = connectSocket(path);
+  if (running >= 0) {
+    ::close(running);
+    throw std::runtime_error("Directory is watched already: " +
+                             _base.string());
+  }
+  // Remove a stale socket left over by a crashed watch process.
+  ::unlink(path.c_str());
+  // Only the owner of the watch process may connect, whatever the umask.
+  _socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  mode_t mask = ::umask(077);
+  bool bound = _socket >= 0 &&
+               ::bind(_socket, reinterpret_cast<sockaddr *>(&address),
+                      sizeof(address)) == 0;
+  ::umask(mask);
+  if (!bound || ::listen(_socket, 16) != 0) {
+    int error = errno;
+    if (_socket >= 0) {
+      ::close(_socket);
+      _socket = -1;
+    }
+    errno = error;
+    throwErrno("Failed to set up socket", path);
+  }
+
+  // Stop on SIGINT and SIGTERM, interrupting poll.
+  struct sigaction action = {}, oldInt = {}, oldTerm = {};
+  action.sa_handler = requestStop;
+  sigemptyset(&action.sa_mask);
+  stopRequested = 0;
+  ::sigaction(SIGINT, &action, &oldInt);
+  ::sigaction(SIGTERM, &action, &oldTerm);
+  try {
+    while (!stopRequested) {
+      pollfd fds[2] = {{_inotify, POLLIN, 0}, {_socket, POLLIN, 0}};
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throwErrno("Failed to wait for events", path);
+      }
+      // Keep the listings warm, not only when requested.
+      if (fds[0].revents & POLLIN) {
+        try {
+          update();
+        } catch (const std::exception &) {
+          // Keep serving, the next request updates again and reports it.
+        }
+      }
+      if (fds[1].revents & POLLIN) {
+        int client = ::accept4(_socket, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+          continue;
+        }
+        timeval timeout = {REQUEST_TIMEOUT, 0};
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                     sizeof(timeout));
+        std::string file;
+        if (receiveLine(client, file) && !file.empty()) {
+          std::string reply = "OK";
+          try {
+            // Text files are written as the watch owner, serve no other user.
+            uid_t uid = 0;
+            if (!peerUser(client, uid) || uid != ::geteuid()) {
+              throw std::runtime_error(
+                  "Watch process belongs to another user.");
+            }
+            checkTarget(file, uid);
+            FileTree tree;
+            build(tree);
+            WriteText::write(tree, file);
+          } catch (const std::exception &e) {
+            reply = describe(e);
+          }
+          sendAll(client, reply + "\n");
+        }
+        ::close(client);
+      }
+    }
+  } catch (...) {
+    ::sigaction(SIGINT, &oldInt, nullptr);
+    ::sigaction(SIGTERM, &oldTerm, nullptr);
+    throw;
+  }
+  ::sigaction(SIGINT, &oldInt, nullptr);
+  ::sigaction(SIGTERM, &oldTerm, nullptr);
+  ::close(_socket);
+  _socket = -1;
+  ::unlink(path.c_str());
+}
@@ -0,0 +1,120 @@
+#ifndef WATCHDIRECTORY_HPP
+#define WATCHDIRECTORY_HPP
+
+#if __has_include(<filesystem>)
+#include <filesystem>
+namespace fs = std::filesystem;
+#else
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+#include "ViFi/ScanCache.hpp"
+#include "ViFi/ScanDirectory.hpp"
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+class FileTree;
+
+/*!
+ * \class WatchDirectory WatchDirectory.hpp "ViFi/WatchDirectory.hpp"
+ * \brief Keep the listings of a directory tree up to date with inotify.
+ *
+ * Scans a directory tree once and holds all directory listings in memory,
+ * watching every directory for entries being created, deleted or moved. Only
+ * directories with events are read again, new subdirectories are scanned and
+ * removed ones dropped. If the inotify queue overflows, the directory stamps
+ * are compared to find the changed directories.
+ *
+ * A file tree built from the listings has the same entry ids as a fresh scan
+ * of the directory, without reading any unchanged directory. Other processes
+ * request the text file of the tree through a unix socket in the watched
+ * directory, see serve() and request().
+ *
+ * \remark Available on Linux only.
+ */
+class WatchDirectory {
+public:
+  /*!
+   * \brief Get the socket path of a watched directory.
+   * \param directory Canonical path of the watched directory.
+   */
+  static fs::path socketPath(const fs::path &directory);
+
+  /*!
+   * \brief Request the text file of a directory from a watch process.
+   * \param directory Path of the directory to be scanned.
+   * \param file Location for the output text file.
+   * \return False if no watch process serves the directory.
+   * \exception std::runtime_error If the watch process failed to write.
+   */
+  static bool request(const fs::path &directory, const fs::path &file);
+
+  /*!
+   * \brief Scan a directory and start watching it.
+   * \param directory Path of the directory to be watched.
+   * \param options Settings for the backend used to read directories.
+   * \exception std::nested_exception Wrapped-up internal exception.
+   */
+  WatchDirectory(const fs::path &directory,
+                 const ScanDirectory::Options &options);
+  ~WatchDirectory(); //!< Stop watching and close the socket.
+
+  WatchDirectory(const WatchDirectory &) = delete; //!< Not copyable.
+  //! Not copyable.
+  WatchDirectory &operator=(const WatchDirectory &) = delete;
+
+  /*!
+   * \brief Process pending events and read the changed directories.
+   *
+   * Directories that cannot be watched or read are remembered as failed and
+   * tried again with every update, see build().
+   * \exception std::runtime_error If reading the events fails.
+   */
+  void update();
+
+  /*!
+   * \brief Load the current filesystem structure into a file tree.
+   * \param tree Empty file tree to store the directory structure.
+   * \return Number of entries added to the tree.
+   * \exception std::runtime_error If a directory could not be watched or
+   *            read, like a fresh scan would fail.
+   */
+  std::size_t build(FileTree &tree);
+
+  /*!
+   * \brief Serve text file requests on the socket until interrupted.
+   *
+   * Listens on socketPath(), keeps the listings updated between requests and
+   * writes the text file to the requested location. Returns on SIGINT or
+   * SIGTERM and removes the socket.
+   *
+   * \exception std::runtime_error If the socket cannot be set up.
+   */
+  void serve();
+
+private:
+  // Start watching a directory and read its subtree.
+  void add(const std::string &key);
+  // Stop watching a directory and forget its subtree.
+  void drop(const std::string &key);
+  // Read a changed directory again, add and drop subdirectories accordingly.
+  void refresh(const std::string &key);
+  // Collect the directories changed by pending inotify events.
+  void process();
+
+  fs::path _base;                  // Canonical path of the watched directory.
+  ScanDirectory::Options _options; // Settings for reading directories.
+  ScanCache _listings;             // Current directory listings by key.
+  int _inotify;                    // Inotify file descriptor.
+  int _socket;                     // Listening socket, -1 if not serving.
+  std::unordered_map<int, std::string> _keys;    // Directory keys by watch.
+  std::unordered_map<std::string, int> _watches; // Watches by directory key.
+  std::set<std::string> _dirty; // Keys of directories to be read again.
+  std::map<std::string, std::string> _failed; // Errors by directory key.
+  bool _overflow; // Set if inotify events were lost.
+};
+
+#endif // WATCHDIRECTORY_HPP
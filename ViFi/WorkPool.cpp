@@ -0,0 +1,129 @@
+#include "ViFi/WorkPool.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace {
+// Pool of the worker thread that is currently running, if any.
+thread_local const WorkPool *currentPool = nullptr;
+// Queue index of the worker thread that is currently running.
+thread_local std::size_t currentIndex = 0;
+} // namespace
+
+WorkPool::WorkPool(std::size_t threads)
+    : _queued(0), _pending(0), _next(0), _stop(false) {
+  if (threads == 0) {
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    _queues.emplace_back(new Queue());
+  }
+  for (std::size_t i = 0; i < threads; ++i) {
+    _threads.emplace_back(&WorkPool::work, this, i);
+  }
+}
+
+WorkPool::~WorkPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (std::thread &thread : _threads) {
+    thread.join();
+  }
+}
+
+std::size_t WorkPool::threads() const { return _threads.size(); }
+
+void WorkPool::push(Task task) {
+  // Workers push to their own queue, others distribute round robin. Count
+  // the task before it is queued, it may be taken and done right away.
+  std::size_t index = 0;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (currentPool == this) {
+      index = currentIndex;
+    } else {
+      index = _next;
+      _next = (_next + 1) % _queues.size();
+    }
+    ++_queued;
+    ++_pending;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+    _queues[index]->tasks.push_back(std::move(task));
+  }
+  _wake.notify_one();
+}
+
+void WorkPool::wait() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [this] { return _pending == 0; });
+  if (_error) {
+    std::exception_ptr error = _error;
+    _error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void WorkPool::work(std::size_t index) {
+  currentPool = this;
+  currentIndex = index;
+  while (true) {
+    Task task;
+    if (take(index, task)) {
+      bool failed = false;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_queued;
+        failed = static_cast<bool>(_error);
+      }
+      // Skip remaining tasks once a task failed.
+      if (!failed) {
+        try {
+          task();
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(_mutex);
+          if (!_error) {
+            _error = std::current_exception();
+          }
+        }
+      }
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (--_pending == 0) {
+        _done.notify_all();
+      }
+    } else {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [this] { return _stop || _queued > 0; });
+      if (_stop) {
+        return;
+      }
+    }
+  }
+}
+
+bool WorkPool::take(std::size_t index, Task &task) {
+  // Take the most recent task from the own queue first.
+  {
+    Queue &own = *_queues[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  // Steal the oldest task from the other queues.
+  for (std::size_t i = 1; i < _queues.size(); ++i) {
+    Queue &other = *_queues[(index + i) % _queues.size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
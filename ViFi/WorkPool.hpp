@@ -0,0 +1,85 @@
+#ifndef WORKPOOL_HPP
+#define WORKPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * \class WorkPool WorkPool.hpp "ViFi/WorkPool.hpp"
+ * \brief Runs tasks on a fixed number of worker threads with work stealing.
+ *
+ * Every worker thread owns a task queue. Tasks pushed from within a worker are
+ * appended to its own queue and taken back from the end, which keeps related
+ * work on the same thread. Idle workers steal tasks from the front of other
+ * queues, so that long running tasks do not leave the other threads idle.
+ *
+ * Typical usage goes as follows:
+ * 1. Push initial tasks through push(), tasks may push follow-up tasks.
+ * 2. Call wait() to block until all tasks are done.
+ */
+class WorkPool {
+public:
+  typedef std::function<void()> Task; //!< Unit of work run by a worker.
+
+  /*!
+   * \brief Start the worker threads.
+   * \param threads Number of worker threads, 0 uses one per hardware thread.
+   */
+  explicit WorkPool(std::size_t threads);
+  ~WorkPool(); //!< Stop and join the worker threads.
+
+  WorkPool(const WorkPool &) = delete;            //!< Not copyable.
+  WorkPool &operator=(const WorkPool &) = delete; //!< Not copyable.
+
+  /*!
+   * \brief Get the number of worker threads.
+   */
+  std::size_t threads() const;
+
+  /*!
+   * \brief Add a task to be run by one of the worker threads.
+   * \param task Task to be run, may push further tasks itself.
+   */
+  void push(Task task);
+
+  /*!
+   * \brief Wait until all pushed tasks are done.
+   *
+   * If a task throws, the remaining queued tasks are discarded and the first
+   * exception is rethrown here.
+   */
+  void wait();
+
+private:
+  // Task queue owned by one worker thread.
+  struct Queue {
+    std::mutex mutex;       // Protects the tasks of this queue.
+    std::deque<Task> tasks; // Queued tasks, owner takes from the back.
+  };
+
+  // Main loop of worker thread with given index.
+  void work(std::size_t index);
+  // Take a task from own queue or steal one from another queue.
+  bool take(std::size_t index, Task &task);
+
+  std::vector<std::unique_ptr<Queue>> _queues; // One queue per worker thread.
+  std::vector<std::thread> _threads;           // Worker threads.
+
+  std::mutex _mutex;             // Protects counters, error and stop flag.
+  std::condition_variable _wake; // Signals queued tasks to idle workers.
+  std::condition_variable _done; // Signals completion of all tasks.
+  std::size_t _queued;           // Number of tasks waiting in queues.
+  std::size_t _pending;          // Number of tasks queued or running.
+  std::size_t _next;             // Queue for the next task pushed from outside.
+  std::exception_ptr _error;     // First exception thrown by a task.
+  bool _stop;                    // Set to terminate the worker threads.
+};
+
+#endif // WORKPOOL_HPP
@@ -1,12 +1,20 @@
 #include "ViFi/WriteText.hpp"
 #include "ViFi/FileTree.hpp"
+#include "ViFi/TreeView.hpp"
+#include <array>
+#include <cerrno>
 #include <exception>
-#include <fstream>
-#include <iomanip>
+#include <fcntl.h>
+#include <functional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
 
 namespace {
+constexpr std::size_t BLOCK_SIZE = 1 << 20; // Bytes handed out at once.
 
 // Compute the number of hex digits needed to express an entry id.
 constexpr int hexWidth(FileTree::Id maxId) {
@@ -16,54 +24,183 @@ constexpr int hexWidth(FileTree::Id maxId) {
   return 0;
 }
 
-void writeNode(const FileTree &tree, const FileTree::Node *node,
-               const fs::path &dir, std::ostream &out) {
-  FileTree::Range range = tree.entries(node);
-  // Check for directory content.
-  if (range.begin != range.end) {
-    int width = hexWidth(tree.maxEntryId());
-    // Iterate through directory content.
-    for (auto it = range.begin; it != range.end; ++it) {
-      const FileTree::Node *sub = *it;
-      fs::path name = FileTree::nodeName(sub);
-      fs::path path = dir.empty() ? name : dir / name;
-      // Write entry id.
-      out << std::right << std::setfill('0') << std::setw(width) << std::hex
-          << FileTree::nodeId(sub);
-      // Write entry path, separated by a tab character.
-      out << '\t' << WriteText::pathToString(path) << std::endl;
-      // Recursively write subdirectories.
-      writeNode(tree, sub, path, out);
+// Two lower case hex digits for every byte value.
+constexpr std::array<char, 512> hexTable() {
+  std::array<char, 512> table = {};
+  const char digits[] = "0123456789abcdef";
+  for (std::size_t i = 0; i < 256; ++i) {
+    table[2 * i] = digits[i >> 4];
+    table[2 * i + 1] = digits[i & 15];
+  }
+  return table;
+}
+constexpr std::array<char, 512> HEX_TABLE = hexTable();
+
+// Collects the text in a buffer and hands it to an output in large blocks.
+class TextBlocks {
+public:
+  typedef std::function<void(const char *, std::size_t)> Output;
+
+  explicit TextBlocks(Output output) : _output(std::move(output)) {
+    _buffer.reserve(BLOCK_SIZE);
+  }
+
+  // Append text, hand out the buffer when it is full.
+  void append(std::string_view text) {
+    _buffer.append(text.data(), text.size());
+    if (_buffer.size() >= BLOCK_SIZE - 1024) {
+      flush();
     }
   }
+
+  // Append an id in hex, zero padded to width like std::setw does.
+  void appendId(FileTree::Id id, int width) {
+    char digits[2 * sizeof(FileTree::Id)];
+    std::size_t begin = sizeof(digits);
+    for (FileTree::Id rest = id; rest > 0 || begin == sizeof(digits);
+         rest >>= 8) {
+      begin -= 2;
+      const char *pair = &HEX_TABLE[2 * (rest & 0xff)];
+      digits[begin] = pair[0];
+      digits[begin + 1] = pair[1];
+    }
+    // Leading zero digit of an odd number of digits only counts for width.
+    std::size_t size = sizeof(digits) - begin;
+    if (digits[begin] == '0' && size > 1) {
+      --size;
+    }
+    if (static_cast<std::size_t>(width) > size) {
+      _buffer.append(static_cast<std::size_t>(width) - size, '0');
+    }
+    _buffer.append(digits + sizeof(digits) - size, size);
+  }
+
+  // Hand the buffered text to the output.
+  void flush() {
+    if (!_buffer.empty()) {
+      _output(_buffer.data(), _buffer.size());
+      _buffer.clear();
+    }
+  }
+
+private:
+  Output _output;      // Receives blocks of text.
+  std::string _buffer; // Text not handed out yet.
+};
+
+// Write the entries below a node in the view, iteratively so that deep trees
+// do not exhaust the stack.
+void writeNode(const FileTree &tree, const FileTree::Node *node, int width,
+               const TreeView *view, TextBlocks &text) {
+  // Entries left in a directory, the size of its path and the view of its
+  // entries, null if they are all part of it.
+  struct Frame {
+    FileTree::Range range;
+    std::size_t size;
+    const TreeView *view;
+  };
+  // The path of each entry is built in one buffer.
+  std::string path;
+  std::vector<Frame> stack = {{tree.entries(node), 0, view}};
+  while (!stack.empty()) {
+    Frame &frame = stack.back();
+    if (frame.range.begin == frame.range.end) {
+      stack.pop_back();
+      continue;
+    }
+    const FileTree::Node *sub = *(frame.range.begin++);
+    const TreeView *subView = frame.view;
+    path.resize(frame.size);
+    if (frame.size > 0) {
+      path += '/';
+    }
+    path += FileTree::nodeNameView(sub);
+    // Everything below an entry of the view is part of the view as well.
+    bool inside = !subView || subView->contains(path);
+    if (inside) {
+      // Write entry id and path, separated by a tab character.
+      text.appendId(FileTree::nodeId(sub), width);
+      text.append("\t");
+      text.append(path);
+      text.append("\n");
+    }
+    // Continue with the directory content.
+    if (inside || subView->reaches(path)) {
+      stack.push_back(
+          {tree.entries(sub), path.size(), inside ? nullptr : subView});
+    }
+  }
+}
+
+// Write the text of a file tree to an output.
+void writeText(const FileTree &tree, const TreeView *view, TextBlocks &text) {
+  // Write path of the base directory.
+  text.append("# ViFi@");
+  text.append(WriteText::pathToString(tree.basePath()));
+  text.append("\n");
+  // Write directory tree.
+  writeNode(tree, tree.baseNode(), hexWidth(tree.maxEntryId()), view, text);
+  text.flush();
 }
 
+// Throw a system error for the current errno value.
+[[noreturn]] void throwErrno(const std::string &what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
 } // namespace
 
 std::string WriteText::pathToString(const fs::path &path) {
   return path.generic_string();
 }
 
-void WriteText::write(const FileTree &tree, const fs::path &file) {
+void WriteText::write(const FileTree &tree, const fs::path &file,
+                      const TreeView *view) {
   try {
-    // Open file in write mode and write tree file to it as an IO device.
-    std::ofstream out(file.string(), std::ios_base::out | std::ios_base::trunc);
-    out.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-    if (!out.is_open()) {
-      throw std::runtime_error("Unable to open file for writing.");
+    // Open file in write mode and write the text to it in large blocks.
+    int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0666);
+    if (fd < 0) {
+      throwErrno("Unable to open file for writing");
+    }
+    TextBlocks text([fd](const char *data, std::size_t size) {
+      while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno != EINTR) {
+          throwErrno("Error writing file");
+        } else if (written == 0) {
+          // No progress and no error, do not retry forever.
+          throw std::system_error(EIO, std::generic_category(),
+                                  "Error writing file");
+        } else if (written > 0) {
+          data += written;
+          size -= static_cast<std::size_t>(written);
+        }
+      }
+    });
+    try {
+      writeText(tree, view, text);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    if (::close(fd) != 0) {
+      throwErrno("Error closing file");
     }
-    write(tree, out);
   } catch (...) {
     std::throw_with_nested(
         std::runtime_error("Failed to write file " + file.string()));
   }
 }
 
-void WriteText::write(const FileTree &tree, std::ostream &out) {
-  // Write path of the base directory.
-  out << "# ViFi@" << pathToString(tree.basePath()) << std::endl;
-  // Write directory tree to text file.
-  writeNode(tree, tree.baseNode(), fs::path(), out);
+void WriteText::write(const FileTree &tree, std::ostream &out,
+                      const TreeView *view) {
+  TextBlocks text([&out](const char *data, std::size_t size) {
+    out.write(data, static_cast<std::streamsize>(size));
+    if (!out) {
+      throw std::runtime_error("Error writing text.");
+    }
+  });
+  writeText(tree, view, text);
   // Finish writing.
   out.flush();
 }
@@ -12,6 +12,7 @@ namespace fs = std::experimental::filesystem;
 #include <ostream>
 
 class FileTree;
+class TreeView;
 
 /*!
  * \class WriteText WriteText.hpp "ViFi/WriteText.hpp"
@@ -36,6 +37,7 @@ public:
    * \param tree A populated file tree with its base path set.
    * \param file Location for the output file, a valid file name in an existing
    *             and writable directory.
+   * \param view Part of the tree to write, all entries if null.
    *
    * Extracts the base path and entries from the file tree and writes
    * them into a text file at the target path. The output format must be
@@ -44,12 +46,14 @@ public:
    * \warning Existing files at the output file location will be overwritten.
    * \throws std::nested_exception Wrapped-up internal exception.
    */
-  static void write(const FileTree &tree, const fs::path &file);
+  static void write(const FileTree &tree, const fs::path &file,
+                    const TreeView *view = nullptr);
 
   /*!
    * \brief Write file tree data to an I/O-device.
    * \param tree A populated file tree with its base path set.
    * \param out Open output stream ready to be written to.
+   * \param view Part of the tree to write, all entries if null.
    *
    * Extracts the base path and entries from the file tree and writes
    * them as a text file to the I/O-device. The output format must be
@@ -58,7 +62,8 @@ public:
    * \remark This method is merely intended for testing.
    * \throws std::runtime_error Error writing the file.
    */
-  static void write(const FileTree &tree, std::ostream &out);
+  static void write(const FileTree &tree, std::ostream &out,
+                    const TreeView *view = nullptr);
 };
 
 #endif // WRITETEXT_HPP
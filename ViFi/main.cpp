@@ -2,10 +2,16 @@
 #include "ViFi/FileTree.hpp"
 #include "ViFi/ReadText.hpp"
 #include "ViFi/ScanDirectory.hpp"
+#include "ViFi/TreeView.hpp"
 #include "ViFi/WriteText.hpp"
+#ifdef __linux__
+#include "ViFi/WatchDirectory.hpp"
+#endif
+#include <chrono>
 #include <cstdio>
 #include <exception>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -26,6 +32,27 @@ void printException(const std::exception &exception, unsigned int level = 0) {
   }
 }
 
+/*!
+ * \brief Parse the numeric value of a command line option.
+ * \param option Name of the option, for error messages.
+ * \param value Option value to be parsed.
+ * \return Numeric value of the option.
+ * \exception std::runtime_error On invalid numbers.
+ */
+std::size_t parseNumber(const std::string &option, const std::string &value) {
+  std::size_t parsed = 0;
+  unsigned long number = 0;
+  try {
+    number = std::stoul(value, &parsed);
+  } catch (const std::exception &) {
+    parsed = 0;
+  }
+  if (parsed == 0 || parsed != value.size()) {
+    throw std::runtime_error("Invalid value " + value + " for " + option);
+  }
+  return number;
+}
+
 /*!
  * \brief ViFi main function, argument parsing and process flow.
  */
@@ -41,29 +68,185 @@ int main(int argc, char *argv[]) {
 
   if (arguments.size() >= 2) {
     // Scan a directory and write its content to a ViFi text file.
-    if (arguments.at(1) == "scan" && arguments.size() == 4) {
+    if (arguments.at(1) == "scan" && arguments.size() >= 4) {
       try {
-        FileTree tree;
-        ScanDirectory::scan(arguments.at(2), tree);
-        WriteText::write(tree, arguments.at(3));
+        // Parse scan options preceding the directory and file arguments.
+        ScanDirectory::Options options;
+        bool stats = false;
+        bool watch = true;
+        bool stream = false;
+        std::string snapshot;
+        TreeView view;
+        std::vector<std::string> paths;
+        for (std::size_t i = 2; i < arguments.size(); ++i) {
+          const std::string &option = arguments.at(i);
+          if (option == "--threads" && i + 1 < arguments.size()) {
+            options.threads = parseNumber(option, arguments.at(++i));
+          } else if (option == "--backend" && i + 1 < arguments.size()) {
+            options.backend = ScanDirectory::backend(arguments.at(++i));
+          } else if (option == "--queue-depth" && i + 1 < arguments.size()) {
+            options.queueDepth = static_cast<unsigned>(
+                parseNumber(option, arguments.at(++i)));
+          } else if (option == "--cache" && i + 1 < arguments.size()) {
+            options.cache = arguments.at(++i);
+          } else if (option == "--stats") {
+            stats = true;
+          } else if (option == "--include" && i + 1 < arguments.size()) {
+            options.include.push_back(arguments.at(++i));
+          } else if (option == "--exclude" && i + 1 < arguments.size()) {
+            options.exclude.push_back(arguments.at(++i));
+          } else if (option == "--max-depth" && i + 1 < arguments.size()) {
+            options.maxDepth = parseNumber(option, arguments.at(++i));
+          } else if (option == "--one-file-system") {
+            options.oneFileSystem = true;
+          } else if (option == "--no-watch") {
+            watch = false;
+          } else if (option == "--stream") {
+            stream = true;
+          } else if (option == "--snapshot" && i + 1 < arguments.size()) {
+            snapshot = arguments.at(++i);
+          } else if (option == "--subtree" && i + 1 < arguments.size()) {
+            view.setSubtree(arguments.at(++i));
+          } else if (option == "--match" && i + 1 < arguments.size()) {
+            view.setMatch(arguments.at(++i));
+          } else {
+            paths.push_back(option);
+          }
+        }
+        if (paths.size() != 2) {
+          throw std::runtime_error("Usage: ViFiBin scan [options] dir file");
+        }
+        // A view leaves out entries, the complete tree goes to the snapshot.
+        if (!view.whole() && (snapshot.empty() || stream)) {
+          throw std::runtime_error(
+              "Views require --snapshot and cannot be streamed.");
+        }
+        if (!snapshot.empty()) {
+          // Only scans into a file tree write a snapshot, never leave an
+          // outdated one behind.
+          fs::remove(snapshot);
+        }
+        auto start = std::chrono::steady_clock::now();
+#ifdef __linux__
+        // Let a watch process of the directory write the file, if running.
+        // It holds the complete directory structure, thus without filters.
+        bool filtered = !options.include.empty() || !options.exclude.empty() ||
+                        options.maxDepth != ScanDirectory::Options().maxDepth ||
+                        options.oneFileSystem || !view.whole();
+        if (watch && !filtered &&
+            WatchDirectory::request(paths.at(0), paths.at(1))) {
+          if (stats) {
+            auto duration = std::chrono::steady_clock::now() - start;
+            std::cerr << "Written by watch process in "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(
+                             duration)
+                             .count()
+                      << " ms." << std::endl;
+          }
+          return Ok;
+        }
+#endif
+        ScanDirectory::Statistics statistics;
+        if (stream) {
+          // Write the text file while scanning, without a file tree.
+          statistics = ScanDirectory::stream(paths.at(0), paths.at(1), options);
+        } else {
+          FileTree tree;
+          statistics = ScanDirectory::scan(paths.at(0), tree, options);
+          WriteText::write(tree, paths.at(1), &view);
+          if (!snapshot.empty()) {
+            tree.endOriginal();
+            tree.saveSnapshot(snapshot, paths.at(1));
+          }
+        }
+        auto duration = std::chrono::steady_clock::now() - start;
+        if (stats) {
+          std::cerr
+              << "Scanned " << statistics.directories << " directories ("
+              << statistics.cached << " cached), " << statistics.entries
+              << " entries (" << statistics.pruned << " pruned) with "
+              << statistics.syscalls
+              << " system calls, " << statistics.saved << " saved, in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(duration)
+                     .count()
+              << " ms." << std::endl;
+        }
+      } catch (const std::exception &e) {
+        printException(e);
+        return Failure;
+      }
+    }
+#ifdef __linux__
+    // Watch a directory and serve its text file to scan commands.
+    if (arguments.at(1) == "watch" && arguments.size() >= 3) {
+      try {
+        ScanDirectory::Options options;
+        std::vector<std::string> paths;
+        for (std::size_t i = 2; i < arguments.size(); ++i) {
+          const std::string &option = arguments.at(i);
+          if (option == "--backend" && i + 1 < arguments.size()) {
+            options.backend = ScanDirectory::backend(arguments.at(++i));
+          } else {
+            paths.push_back(option);
+          }
+        }
+        if (paths.size() != 1) {
+          throw std::runtime_error("Usage: ViFiBin watch [options] dir");
+        }
+        WatchDirectory watcher(paths.at(0), options);
+        std::cout << "Watching " << paths.at(0) << ", stop with Ctrl+C."
+                  << std::endl;
+        watcher.serve();
       } catch (const std::exception &e) {
         printException(e);
         return Failure;
       }
     }
+#endif
     // Interprete changes between two ViFi text files as file operations.
-    if (arguments.at(1) == "move" && arguments.size() == 4) {
+    if (arguments.at(1) == "move" && arguments.size() >= 4) {
       try {
-        // Read original and target tree from text files.
+        // Parse move options preceding the file arguments.
+        std::size_t threads = 1;
+        std::string snapshot;
+        TreeView view;
+        std::vector<std::string> paths;
+        for (std::size_t i = 2; i < arguments.size(); ++i) {
+          const std::string &option = arguments.at(i);
+          if (option == "--threads" && i + 1 < arguments.size()) {
+            threads = parseNumber(option, arguments.at(++i));
+          } else if (option == "--snapshot" && i + 1 < arguments.size()) {
+            snapshot = arguments.at(++i);
+          } else if (option == "--subtree" && i + 1 < arguments.size()) {
+            view.setSubtree(arguments.at(++i));
+          } else if (option == "--match" && i + 1 < arguments.size()) {
+            view.setMatch(arguments.at(++i));
+          } else {
+            paths.push_back(option);
+          }
+        }
+        if (paths.size() != 2) {
+          throw std::runtime_error("Usage: ViFiBin move [options] file file");
+        }
+        // Read original tree from its snapshot if present and written for the
+        // current text file, otherwise from the text file. The text file of a
+        // view lacks the entries outside.
         FileTree tree;
-        fs::path current(arguments.at(2));
-        ReadText::read(current, tree);
-        tree.endOriginal();
-        fs::path changed(arguments.at(3));
-        ReadText::read(changed, tree);
+        fs::path current(paths.at(0));
+        if (snapshot.empty() || !tree.loadSnapshot(snapshot, current)) {
+          if (!view.whole()) {
+            throw std::runtime_error("Views require the --snapshot of scan.");
+          }
+          ReadText::read(current, tree, threads);
+          tree.endOriginal();
+        }
+        // Read target tree from text file, entries outside the view remain.
+        fs::path changed(paths.at(1));
+        ReadText::read(changed, tree, threads);
+        view.keepOutside(tree);
         // Generate file operations.
         FileOpRunner operations(current.parent_path());
-        tree.endTarget();
+        tree.endTarget(threads);
         tree.generate(operations);
         operations.prepare();
         // Prompt user for executing file operations.